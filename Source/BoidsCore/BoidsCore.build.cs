@@ -0,0 +1,14 @@
+// Copyright Dennis Andersson. All Rights Reserved.
+
+using UnrealBuildTool;
+
+public class BoidsCore : ModuleRules
+{
+	public BoidsCore(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		// Only depends on Core so that it can be built into programs without the engine
+		PublicDependencyModuleNames.AddRange(new string[] { "Core" });
+	}
+}
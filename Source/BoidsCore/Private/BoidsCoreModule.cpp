@@ -0,0 +1,5 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, BoidsCore);
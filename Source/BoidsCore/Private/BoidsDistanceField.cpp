@@ -0,0 +1,139 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsDistanceField.h"
+
+#include "Async/ParallelFor.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	constexpr uint32 DistanceFieldMagic = 0x46445342; // 'BSDF'
+	constexpr uint32 DistanceFieldVersion = 1;
+
+	/** Largest number of samples a field can have, so a corrupt file can not allocate more than a few hundred megabytes */
+	constexpr int64 MaxDistanceFieldSamples = 512 * 512 * 512;
+
+	constexpr float MaxQuantizedDistance = 32767.f;
+}
+
+void FBoidsDistanceField::Build(const FBox& Bounds, const FIntVector& InResolution, TFunctionRef<float(const FVector&)> GetDistance)
+{
+	Reset();
+
+	if (!Bounds.IsValid || InResolution.GetMin() < 2 || (int64)InResolution.X * InResolution.Y * InResolution.Z > MaxDistanceFieldSamples)
+	{
+		return;
+	}
+
+	Min = FVector3f(Bounds.Min);
+	Max = FVector3f(Bounds.Max);
+	Resolution = InResolution;
+	UpdateSampleSpacing();
+
+	Distances.SetNumUninitialized(Resolution.X * Resolution.Y * Resolution.Z);
+
+	const FVector SampleSpacing = FVector(Max - Min) / FVector(Resolution - FIntVector(1));
+
+	// Every slice is independent, the distance function must be safe to call from several threads
+	ParallelFor(Resolution.Z, [this, &SampleSpacing, &GetDistance] (int32 Z)
+	{
+		for (int32 Y = 0; Y < Resolution.Y; Y++)
+		{
+			for (int32 X = 0; X < Resolution.X; X++)
+			{
+				const FVector Location = FVector(Min) + FVector(X, Y, Z) * SampleSpacing;
+				Distances[X + (Y + Z * Resolution.Y) * Resolution.X] = GetDistance(Location);
+			}
+		}
+	});
+}
+
+void FBoidsDistanceField::Save(TArray<uint8>& OutData) const
+{
+	OutData.Reset();
+	FMemoryWriter Writer(OutData);
+
+	float MaxDistance = 0.f;
+	for (const float Distance : Distances)
+	{
+		MaxDistance = FMath::Max(MaxDistance, FMath::Abs(Distance));
+	}
+
+	uint32 Magic = DistanceFieldMagic;
+	uint32 Version = DistanceFieldVersion;
+	FVector3f SavedMin = Min;
+	FVector3f SavedMax = Max;
+	FIntVector SavedResolution = Resolution;
+
+	Writer << Magic << Version << SavedMin << SavedMax << SavedResolution << MaxDistance;
+
+	const float Scale = MaxDistance > 0.f ? MaxQuantizedDistance / MaxDistance : 0.f;
+	for (const float Distance : Distances)
+	{
+		int16 Quantized = (int16)FMath::Clamp(FMath::RoundToInt(Distance * Scale), -(int32)MaxQuantizedDistance, (int32)MaxQuantizedDistance);
+		Writer << Quantized;
+	}
+}
+
+bool FBoidsDistanceField::Load(const TArray<uint8>& Data)
+{
+	Reset();
+
+	FMemoryReader Reader(Data);
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	FVector3f LoadedMin;
+	FVector3f LoadedMax;
+	FIntVector LoadedResolution;
+	float MaxDistance = 0.f;
+
+	Reader << Magic << Version;
+	if (Reader.IsError() || Magic != DistanceFieldMagic || Version != DistanceFieldVersion)
+	{
+		return false;
+	}
+
+	Reader << LoadedMin << LoadedMax << LoadedResolution << MaxDistance;
+
+	const int64 NumSamples = (int64)LoadedResolution.X * LoadedResolution.Y * LoadedResolution.Z;
+	if (Reader.IsError() || LoadedResolution.GetMin() < 2 || NumSamples > MaxDistanceFieldSamples
+		|| Reader.TotalSize() - Reader.Tell() != NumSamples * (int64)sizeof(int16)
+		|| !(LoadedMin.X < LoadedMax.X && LoadedMin.Y < LoadedMax.Y && LoadedMin.Z < LoadedMax.Z))
+	{
+		return false;
+	}
+
+	Min = LoadedMin;
+	Max = LoadedMax;
+	Resolution = LoadedResolution;
+	UpdateSampleSpacing();
+
+	Distances.SetNumUninitialized((int32)NumSamples);
+
+	const float Scale = MaxDistance / MaxQuantizedDistance;
+	for (float& Distance : Distances)
+	{
+		int16 Quantized = 0;
+		Reader << Quantized;
+		Distance = Quantized * Scale;
+	}
+
+	return true;
+}
+
+void FBoidsDistanceField::Reset()
+{
+	Min = FVector3f::ZeroVector;
+	Max = FVector3f::ZeroVector;
+	Resolution = FIntVector::ZeroValue;
+	InvSampleSpacing = FVector3f::ZeroVector;
+	Distances.Empty();
+}
+
+void FBoidsDistanceField::UpdateSampleSpacing()
+{
+	InvSampleSpacing = FVector3f(Resolution - FIntVector(1)) / (Max - Min);
+}
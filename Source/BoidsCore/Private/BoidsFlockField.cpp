@@ -0,0 +1,124 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsFlockField.h"
+
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	/** Smallest number of boids splatted by a block, so that small flocks do not pay for clearing and summing many copies of the nodes */
+	constexpr int32 FlockFieldMinBlockSize = 4096;
+
+	/** Largest number of nodes in all the copies of the blocks */
+	constexpr int32 FlockFieldMaxBlockNodes = 1 << 22;
+}
+
+void FBoidsFlockField::Build(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsFlockFieldSettings& Settings)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BuildFlockField);
+
+	check(Locations.Num() == Velocities.Num());
+
+	NumBufferAllocations = 0;
+
+	NodesPerAxis = FMath::Clamp(Settings.NodesPerAxis, 2, 128);
+	Min = Settings.Origin - FVector3f(Settings.HalfSize);
+	InvNodeSpacing = Settings.HalfSize > 0.f ? (NodesPerAxis - 1) / (Settings.HalfSize * 2.f) : 0.f;
+
+	const int32 NumNodes = NodesPerAxis * NodesPerAxis * NodesPerAxis;
+	const int32 NumBoids = Locations.Num();
+
+	const int32 MaxNumBlocks = FMath::Max(1, FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, FlockFieldMaxBlockNodes / NumNodes));
+	const int32 NumBlocks = FMath::Clamp(FMath::DivideAndRoundUp(NumBoids, FlockFieldMinBlockSize), 1, MaxNumBlocks);
+	const int32 BlockSize = FMath::DivideAndRoundUp(NumBoids, NumBlocks);
+
+	BoidsCore::ResizeBuffer(Nodes, NumNodes, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(BlockNodes, NumNodes * NumBlocks, NumBufferAllocations);
+
+	// Splat each block of boids into its own copy of the nodes
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		FNode* RESTRICT Block = BlockNodes.GetData() + BlockNdx * NumNodes;
+		FMemory::Memzero(Block, NumNodes * sizeof(FNode));
+
+		const int32 StrideY = NodesPerAxis;
+		const int32 StrideZ = NodesPerAxis * NodesPerAxis;
+
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 Ndx = BlockNdx * BlockSize; Ndx < BlockEnd; Ndx++)
+		{
+			const FVector3f Location(Locations.X[Ndx], Locations.Y[Ndx], Locations.Z[Ndx]);
+			const FVector3f Velocity(Velocities.X[Ndx], Velocities.Y[Ndx], Velocities.Z[Ndx]);
+			const FVector3f NodeCoords = (Location - Min) * InvNodeSpacing;
+
+			int32 X, Y, Z;
+			FVector3f Frac;
+			GetNodeCoords(NodeCoords.X, X, Frac.X);
+			GetNodeCoords(NodeCoords.Y, Y, Frac.Y);
+			GetNodeCoords(NodeCoords.Z, Z, Frac.Z);
+
+			FNode* Corner = Block + X + Y * StrideY + Z * StrideZ;
+
+			for (int32 CornerNdx = 0; CornerNdx < 8; CornerNdx++)
+			{
+				const int32 OffsetX = CornerNdx & 1;
+				const int32 OffsetY = (CornerNdx >> 1) & 1;
+				const int32 OffsetZ = (CornerNdx >> 2) & 1;
+
+				const float Weight = (OffsetX ? Frac.X : 1.f - Frac.X) * (OffsetY ? Frac.Y : 1.f - Frac.Y) * (OffsetZ ? Frac.Z : 1.f - Frac.Z);
+
+				FNode& Node = Corner[OffsetX + OffsetY * StrideY + OffsetZ * StrideZ];
+				Node.Velocity += Velocity * Weight;
+				Node.Density += Weight;
+			}
+		}
+	});
+
+	// Sum the copies of the blocks, one slice of nodes at a time
+	ParallelFor(NodesPerAxis, [&] (int32 Z)
+	{
+		const int32 SliceStart = Z * NodesPerAxis * NodesPerAxis;
+		const int32 SliceEnd = SliceStart + NodesPerAxis * NodesPerAxis;
+
+		for (int32 NodeNdx = SliceStart; NodeNdx < SliceEnd; NodeNdx++)
+		{
+			FNode Node = BlockNodes[NodeNdx];
+			for (int32 BlockNdx = 1; BlockNdx < NumBlocks; BlockNdx++)
+			{
+				const FNode& BlockNode = BlockNodes[BlockNdx * NumNodes + NodeNdx];
+				Node.Velocity += BlockNode.Velocity;
+				Node.Density += BlockNode.Density;
+			}
+
+			Nodes[NodeNdx] = Node;
+		}
+	});
+}
+
+void BoidsCore::AddFlockSteering(const FBoidsFlockField& Field, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsFlockRuleSettings& Settings, TArrayView<FVector> InOutSteerings)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_AddFlockSteering);
+
+	check(Locations.Num() == InOutSteerings.Num() && Velocities.Num() == InOutSteerings.Num());
+
+	if (!Field.IsValid())
+	{
+		return;
+	}
+
+	ParallelFor(InOutSteerings.Num(), [&] (int32 Ndx)
+	{
+		const FVector3f Location(Locations.X[Ndx], Locations.Y[Ndx], Locations.Z[Ndx]);
+		const FVector3f Velocity(Velocities.X[Ndx], Velocities.Y[Ndx], Velocities.Z[Ndx]);
+
+		const FBoidsFlockSample Sample = Field.SampleOthers(Location, Velocity);
+		if (Sample.Density < FMath::Max(Settings.MinDensity, KINDA_SMALL_NUMBER))
+		{
+			return;
+		}
+
+		const FVector3f Steering = Sample.DensityGradient.GetSafeNormal() * Settings.Cohesion + (Sample.Velocity / Sample.Density - Velocity) * Settings.Alignment;
+		InOutSteerings[Ndx] += FVector(Steering);
+	});
+}
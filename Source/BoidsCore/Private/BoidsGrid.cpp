@@ -0,0 +1,317 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsGrid.h"
+
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+namespace
+{
+	/** Minimum number of boids each block handles when building the grid */
+	constexpr int32 GridMinBlockSize = 2048;
+
+	/** Maximum number of per block cell counts used when building the grid */
+	constexpr int32 GridMaxBlockCounts = 4 * 1024 * 1024;
+}
+
+void FBoidsGrid::UpdateGridLayout(const FBoidsGridSettings& Settings)
+{
+	// Cells must be at least as large as the largest distance so that the surrounding cells contain every boid in range
+	const float MaxDistance = FMath::Max(Settings.MaxDistance, 1.f);
+
+	const float HalfSize = FMath::Max(Settings.HalfSize, 1.f);
+	const int32 MaxCellsPerAxis = FMath::Clamp(Settings.MaxCellsPerAxis, 1, FBoidsGridLayout::MaxCellsPerAxis);
+	const int32 NumCellsPerAxis = FMath::Clamp(FMath::FloorToInt((HalfSize * 2.f) / MaxDistance), 1, MaxCellsPerAxis);
+
+	GridLayout.Min = Settings.Origin - FVector3f(HalfSize);
+	GridLayout.InvCellSize = NumCellsPerAxis / (HalfSize * 2.f);
+	GridLayout.NumCells = FIntVector(NumCellsPerAxis);
+	GridLayout.bMortonOrder = Settings.bMortonOrder;
+
+	if (GridLayout.bMortonOrder)
+	{
+		// Z-order indices cover a power of two along each axis
+		const int32 NumMortonCellsPerAxis = FMath::RoundUpToPowerOfTwo(NumCellsPerAxis);
+		GridLayout.NumCellIndices = NumMortonCellsPerAxis * NumMortonCellsPerAxis * NumMortonCellsPerAxis;
+	}
+	else
+	{
+		GridLayout.NumCellIndices = NumCellsPerAxis * NumCellsPerAxis * NumCellsPerAxis;
+	}
+}
+
+void FBoidsGrid::Setup(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsGridSettings& Settings, const bool bReordered)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SetupBoidsGrid);
+
+	const int32 NumBoids = Locations.Num();
+	check(Velocities.Num() == NumBoids);
+
+	NumBufferAllocations = 0;
+	bReorderedBoids = bReordered;
+
+	const FBoidsGridLayout PrevGridLayout = GridLayout;
+	UpdateGridLayout(Settings);
+
+	const int32 NumGrids = GridLayout.Num();
+
+	// Keep the grid of the last frame so that it can be updated instead of rebuilt
+	Swap(GridBoids, PrevGridBoids);
+	Swap(BoidsGridSlot, PrevBoidsGridSlot);
+	Swap(SortedGridIndex, PrevSortedGridIndex);
+	Swap(GridCellStart, PrevGridCellStart);
+	Swap(GridCellCount, PrevGridCellCount);
+
+	// The previous grid can only be used if it refers to the same boids in the same cells
+	const bool bCanUpdateGrid = Settings.bIncremental
+		&& bPrevGridValid
+		&& bPrevGridReordered == bReorderedBoids
+		&& PrevGridBoids.Num() == NumBoids
+		&& PrevGridLayout == GridLayout;
+
+	// Split the boids in blocks that each count and write their own boids, which keeps the order in each cell stable
+	const int32 MaxNumBlocks = FMath::Max(1, FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads() * 2, GridMaxBlockCounts / NumGrids));
+	const int32 NumBlocks = FMath::Clamp(FMath::DivideAndRoundUp(NumBoids, GridMinBlockSize), 1, MaxNumBlocks);
+	const int32 BlockSize = FMath::DivideAndRoundUp(NumBoids, NumBlocks);
+
+	BoidsCore::ResizeBuffer(BoidsGridIndex, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridBlockMovers, NumBlocks, NumBufferAllocations);
+
+	// Get the grid for each boid and count how many boids changed grid since the last frame
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		int32 NumBlockMovers = 0;
+
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 Ndx = BlockNdx * BlockSize; Ndx < BlockEnd; Ndx++)
+		{
+			const FIntVector Cell = GridLayout.GetCell(Locations.X[Ndx], Locations.Y[Ndx], Locations.Z[Ndx]);
+			const int32 GridNdx = GridLayout.GetCellIndex(Cell);
+
+			BoidsGridIndex[Ndx] = GridNdx;
+
+			if (bCanUpdateGrid)
+			{
+				// Reordered boids are already in the grid order of the last frame
+				const int32 PrevGridSlot = bReorderedBoids ? Ndx : PrevBoidsGridSlot[Ndx];
+				NumBlockMovers += PrevSortedGridIndex[PrevGridSlot] != GridNdx;
+			}
+		}
+
+		GridBlockMovers[BlockNdx] = NumBlockMovers;
+	});
+
+	int32 NumMovers = 0;
+	for (int32 BlockNdx = 0; BlockNdx < NumBlocks; BlockNdx++)
+	{
+		const int32 NumBlockMovers = GridBlockMovers[BlockNdx];
+		GridBlockMovers[BlockNdx] = NumMovers;
+		NumMovers += NumBlockMovers;
+	}
+
+	if (bCanUpdateGrid && NumMovers <= NumBoids * Settings.RebuildThreshold)
+	{
+		UpdateGrid(NumBoids, NumBlocks, BlockSize, NumMovers);
+	}
+	else
+	{
+		BuildGrid(NumBoids, NumBlocks, BlockSize);
+	}
+
+	bPrevGridValid = true;
+	bPrevGridReordered = bReorderedBoids;
+
+	BoidsCore::ResizeBuffer(SortedGridIndex, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(SortedLocations, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(SortedVelocities, NumBoids, NumBufferAllocations);
+
+	// Copy the boids in grid order so the rules can read each range of cells contiguously
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 SortedNdx = BlockNdx * BlockSize; SortedNdx < BlockEnd; SortedNdx++)
+		{
+			const int32 Ndx = GridBoids[SortedNdx];
+
+			SortedGridIndex[SortedNdx] = BoidsGridIndex[Ndx];
+
+			SortedLocations.X[SortedNdx] = Locations.X[Ndx];
+			SortedLocations.Y[SortedNdx] = Locations.Y[Ndx];
+			SortedLocations.Z[SortedNdx] = Locations.Z[Ndx];
+
+			SortedVelocities.X[SortedNdx] = Velocities.X[Ndx];
+			SortedVelocities.Y[SortedNdx] = Velocities.Y[Ndx];
+			SortedVelocities.Z[SortedNdx] = Velocities.Z[Ndx];
+		}
+	});
+}
+
+void FBoidsGrid::BuildGrid(const int32 NumBoids, const int32 NumBlocks, const int32 BlockSize)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BuildBoidsGrid);
+
+	const int32 NumGrids = GridLayout.Num();
+
+	BoidsCore::ResizeBuffer(GridBoids, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(BoidsGridSlot, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridCellStart, NumGrids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridCellCount, NumGrids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridBlockOffsets, NumBlocks * NumGrids, NumBufferAllocations);
+
+	// Count the boids per grid in each block
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		int32* BlockCounts = GridBlockOffsets.GetData() + BlockNdx * NumGrids;
+		FMemory::Memzero(BlockCounts, NumGrids * sizeof(int32));
+
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 Ndx = BlockNdx * BlockSize; Ndx < BlockEnd; Ndx++)
+		{
+			++BlockCounts[BoidsGridIndex[Ndx]];
+		}
+	});
+
+	// Turn the block counts into offsets inside of each grid
+	ParallelFor(NumGrids, [&] (int32 GridNdx)
+	{
+		int32 GridCount = 0;
+		for (int32 BlockNdx = 0; BlockNdx < NumBlocks; BlockNdx++)
+		{
+			int32& BlockOffset = GridBlockOffsets[BlockNdx * NumGrids + GridNdx];
+			const int32 BlockCount = BlockOffset;
+
+			BlockOffset = GridCount;
+			GridCount += BlockCount;
+		}
+
+		GridCellCount[GridNdx] = GridCount;
+	});
+
+	int32 GridStart = 0;
+	for (int32 GridNdx = 0; GridNdx < NumGrids; GridNdx++)
+	{
+		GridCellStart[GridNdx] = GridStart;
+		GridStart += GridCellCount[GridNdx];
+	}
+
+	// Write the boids of each block into their grids
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		int32* BlockOffsets = GridBlockOffsets.GetData() + BlockNdx * NumGrids;
+
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 Ndx = BlockNdx * BlockSize; Ndx < BlockEnd; Ndx++)
+		{
+			const int32 GridNdx = BoidsGridIndex[Ndx];
+			const int32 GridSlot = GridCellStart[GridNdx] + BlockOffsets[GridNdx]++;
+
+			GridBoids[GridSlot] = Ndx;
+			BoidsGridSlot[Ndx] = GridSlot;
+		}
+	});
+}
+
+void FBoidsGrid::UpdateGrid(const int32 NumBoids, const int32 NumBlocks, const int32 BlockSize, const int32 NumMovers)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_UpdateBoidsGrid);
+
+	// Nothing changed, the grid of the last frame can be used as is
+	if (NumMovers == 0 && !bReorderedBoids)
+	{
+		Swap(GridBoids, PrevGridBoids);
+		Swap(BoidsGridSlot, PrevBoidsGridSlot);
+		Swap(GridCellStart, PrevGridCellStart);
+		Swap(GridCellCount, PrevGridCellCount);
+		return;
+	}
+
+	const int32 NumGrids = GridLayout.Num();
+
+	const auto GetPrevGridSlot = [this] (const int32 Ndx)
+	{
+		return bReorderedBoids ? Ndx : PrevBoidsGridSlot[Ndx];
+	};
+
+	BoidsCore::ResizeBuffer(GridBoids, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(BoidsGridSlot, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridCellStart, NumGrids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridCellCount, NumGrids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridBlockOffsets, NumGrids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridMovers, NumMovers, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(GridArrivals, NumMovers, NumBufferAllocations);
+
+	// Collect the boids that changed grid in boid order
+	ParallelFor(NumBlocks, [&] (int32 BlockNdx)
+	{
+		int32 MoverNdx = GridBlockMovers[BlockNdx];
+
+		const int32 BlockEnd = FMath::Min(NumBoids, (BlockNdx + 1) * BlockSize);
+		for (int32 Ndx = BlockNdx * BlockSize; Ndx < BlockEnd; Ndx++)
+		{
+			if (PrevSortedGridIndex[GetPrevGridSlot(Ndx)] != BoidsGridIndex[Ndx])
+			{
+				GridMovers[MoverNdx++] = Ndx;
+			}
+		}
+	});
+
+	// Move the boids between the grid counts and count how many boids arrive in each grid
+	int32* ArrivalOffsets = GridBlockOffsets.GetData();
+	FMemory::Memcpy(GridCellCount.GetData(), PrevGridCellCount.GetData(), NumGrids * sizeof(int32));
+	FMemory::Memzero(ArrivalOffsets, NumGrids * sizeof(int32));
+
+	for (const int32 Ndx : GridMovers)
+	{
+		const int32 GridNdx = BoidsGridIndex[Ndx];
+
+		--GridCellCount[PrevSortedGridIndex[GetPrevGridSlot(Ndx)]];
+		++GridCellCount[GridNdx];
+		++ArrivalOffsets[GridNdx];
+	}
+
+	int32 GridStart = 0;
+	int32 ArrivalStart = 0;
+	for (int32 GridNdx = 0; GridNdx < NumGrids; GridNdx++)
+	{
+		GridCellStart[GridNdx] = GridStart;
+		GridStart += GridCellCount[GridNdx];
+
+		const int32 NumArrivals = ArrivalOffsets[GridNdx];
+		ArrivalOffsets[GridNdx] = ArrivalStart;
+		ArrivalStart += NumArrivals;
+	}
+
+	// Sort the boids that changed grid by their new grid. Afterwards each offset is the end of the arrivals of that grid
+	for (const int32 Ndx : GridMovers)
+	{
+		GridArrivals[ArrivalOffsets[BoidsGridIndex[Ndx]]++] = Ndx;
+	}
+
+	// Each grid keeps the boids that stayed in the same order as the last frame, followed by the ones that arrived
+	ParallelFor(NumGrids, [&] (int32 GridNdx)
+	{
+		int32 GridSlot = GridCellStart[GridNdx];
+
+		const int32 PrevStart = PrevGridCellStart[GridNdx];
+		const int32 PrevEnd = PrevStart + PrevGridCellCount[GridNdx];
+		for (int32 PrevGridSlot = PrevStart; PrevGridSlot < PrevEnd; PrevGridSlot++)
+		{
+			const int32 Ndx = bReorderedBoids ? PrevGridSlot : PrevGridBoids[PrevGridSlot];
+			if (BoidsGridIndex[Ndx] == GridNdx)
+			{
+				GridBoids[GridSlot] = Ndx;
+				BoidsGridSlot[Ndx] = GridSlot++;
+			}
+		}
+
+		const int32 ArrivalEnd = ArrivalOffsets[GridNdx];
+		for (int32 ArrivalNdx = GridNdx > 0 ? ArrivalOffsets[GridNdx - 1] : 0; ArrivalNdx < ArrivalEnd; ArrivalNdx++)
+		{
+			const int32 Ndx = GridArrivals[ArrivalNdx];
+
+			GridBoids[GridSlot] = Ndx;
+			BoidsGridSlot[Ndx] = GridSlot++;
+		}
+	});
+}
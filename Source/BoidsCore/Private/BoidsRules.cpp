@@ -0,0 +1,244 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsRules.h"
+#include "BoidsGrid.h"
+
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	/** Sorted boids and grid cells read by every boid running the rules */
+	struct FBoidsRuleContext
+	{
+		const FBoidsVectorSoA& SortedLocations;
+		const FBoidsVectorSoA& SortedVelocities;
+		const FBoidsGridLayout& GridLayout;
+		const TArray<int32>& GridCellStart;
+		const TArray<int32>& GridCellCount;
+
+		/** Species of each sorted boid, only set when there are several species */
+		const float* SortedSpecies;
+	};
+
+	struct FBoidsSpeciesRules;
+
+	/** Rule kernel getting the steering of a single sorted boid */
+	using FGetBoidSteering = FVector3f(*)(const FBoidsRuleContext& Context, const FBoidsSpeciesRules& SpeciesRules, const int32 SortedNdx);
+
+	/** Rules of a species and the kernel picked for them */
+	struct FBoidsSpeciesRules
+	{
+		FBoidsRuleSettings Settings;
+		BoidsCore::FBoidsRuleDistances Distances;
+		FGetBoidSteering GetSteering;
+	};
+
+	/**
+	 * Get the steering of a sorted boid, only running the rules in the mask. Every combination of rules, kernel and species filter is its own
+	 * function so that the loops over the neighbors have no branches for rules that are disabled
+	 */
+	template<EBoidsRuleMask Rules, bool bVectorized, bool bSameSpeciesOnly>
+	FVector3f GetBoidSteering(const FBoidsRuleContext& Context, const FBoidsSpeciesRules& SpeciesRules, const int32 SortedNdx)
+	{
+		using namespace BoidsCore;
+
+		if (Rules == EBoidsRuleMask::None)
+		{
+			return FVector3f::ZeroVector;
+		}
+
+		const FBoidsVectorSoA& SortedLocations = Context.SortedLocations;
+		const FBoidsVectorSoA& SortedVelocities = Context.SortedVelocities;
+		const FBoidsGridLayout& GridLayout = Context.GridLayout;
+		const FBoidsRuleSettings& Settings = SpeciesRules.Settings;
+		const FBoidsRuleDistances& Distances = SpeciesRules.Distances;
+
+		const FVector3f BoidLocation(SortedLocations.X[SortedNdx], SortedLocations.Y[SortedNdx], SortedLocations.Z[SortedNdx]);
+		const FVector3f BoidVelocity(SortedVelocities.X[SortedNdx], SortedVelocities.Y[SortedNdx], SortedVelocities.Z[SortedNdx]);
+
+		FBoidsSpeciesFilter SpeciesFilter;
+		if (bSameSpeciesOnly)
+		{
+			SpeciesFilter.Species = Context.SortedSpecies;
+			SpeciesFilter.BoidSpecies = Context.SortedSpecies[SortedNdx];
+		}
+
+		// Accumulate all rules in a single pass over the neighbors
+		FBoidsRuleSums Sums;
+
+		const auto AccumulateRange = [&SortedLocations, &SortedVelocities, &BoidLocation, &Distances, &Sums, &SpeciesFilter] (const int32 Start, const int32 End)
+		{
+			if (bVectorized)
+			{
+				AccumulateBoidRulesVectorized<Rules, bSameSpeciesOnly>(SortedLocations, SortedVelocities, BoidLocation, Distances, Start, End, Sums, SpeciesFilter);
+			}
+			else
+			{
+				AccumulateBoidRules<Rules, bSameSpeciesOnly>(SortedLocations, SortedVelocities, BoidLocation, Distances, Start, End, Sums, SpeciesFilter);
+			}
+		};
+
+		const FIntVector Cell = GridLayout.GetCell(BoidLocation.X, BoidLocation.Y, BoidLocation.Z);
+		const FIntVector MinCell = FIntVector(FMath::Max(Cell.X - 1, 0), FMath::Max(Cell.Y - 1, 0), FMath::Max(Cell.Z - 1, 0));
+		const FIntVector MaxCell = FIntVector(FMath::Min(Cell.X + 1, GridLayout.NumCells.X - 1), FMath::Min(Cell.Y + 1, GridLayout.NumCells.Y - 1), FMath::Min(Cell.Z + 1, GridLayout.NumCells.Z - 1));
+
+		for (int32 CellZ = MinCell.Z; CellZ <= MaxCell.Z; CellZ++)
+		{
+			for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; CellY++)
+			{
+				if (GridLayout.bMortonOrder)
+				{
+					for (int32 CellX = MinCell.X; CellX <= MaxCell.X; CellX++)
+					{
+						const int32 GridNdx = GridLayout.GetCellIndex(FIntVector(CellX, CellY, CellZ));
+						AccumulateRange(Context.GridCellStart[GridNdx], Context.GridCellStart[GridNdx] + Context.GridCellCount[GridNdx]);
+					}
+				}
+				else
+				{
+					// Neighboring cells along X are next to each other in the grid, so their boids are a single range
+					const int32 FirstGridNdx = GridLayout.GetCellIndex(FIntVector(MinCell.X, CellY, CellZ));
+					const int32 LastGridNdx = FirstGridNdx + (MaxCell.X - MinCell.X);
+
+					AccumulateRange(Context.GridCellStart[FirstGridNdx], Context.GridCellStart[LastGridNdx] + Context.GridCellCount[LastGridNdx]);
+				}
+			}
+		}
+
+		FVector3f Steering = FVector3f::ZeroVector;
+
+		// The boid was accumulated as its own neighbor, cohesion should only count other boids.
+		// Its separation is a zero vector so it does not need to be removed.
+		if (EnumHasAnyFlags(Rules, EBoidsRuleMask::Cohesion))
+		{
+			Sums.Cohesion -= BoidVelocity;
+			Sums.NumCohesion -= 1.f;
+
+			if (Sums.NumCohesion > 0.f)
+			{
+				Steering += (Sums.Cohesion / Sums.NumCohesion - BoidVelocity) * Settings.Cohesion;
+			}
+		}
+
+		if (EnumHasAnyFlags(Rules, EBoidsRuleMask::Separation))
+		{
+			Steering += Sums.Separation * Settings.Separation;
+		}
+
+		if (EnumHasAnyFlags(Rules, EBoidsRuleMask::Alignment) && Sums.NumAlignment > 0.f)
+		{
+			Steering += (Sums.Alignment / Sums.NumAlignment - BoidLocation) * Settings.Alignment;
+		}
+
+		return Steering;
+	}
+
+	template<bool bVectorized, bool bSameSpeciesOnly>
+	FGetBoidSteering SelectBoidSteering(const EBoidsRuleMask Rules)
+	{
+		constexpr EBoidsRuleMask Alignment = EBoidsRuleMask::Alignment;
+		constexpr EBoidsRuleMask Separation = EBoidsRuleMask::Separation;
+		constexpr EBoidsRuleMask Cohesion = EBoidsRuleMask::Cohesion;
+
+		switch (Rules)
+		{
+		case EBoidsRuleMask::None:
+			return &GetBoidSteering<EBoidsRuleMask::None, bVectorized, bSameSpeciesOnly>;
+		case Alignment:
+			return &GetBoidSteering<Alignment, bVectorized, bSameSpeciesOnly>;
+		case Separation:
+			return &GetBoidSteering<Separation, bVectorized, bSameSpeciesOnly>;
+		case Cohesion:
+			return &GetBoidSteering<Cohesion, bVectorized, bSameSpeciesOnly>;
+		case Alignment | Separation:
+			return &GetBoidSteering<Alignment | Separation, bVectorized, bSameSpeciesOnly>;
+		case Alignment | Cohesion:
+			return &GetBoidSteering<Alignment | Cohesion, bVectorized, bSameSpeciesOnly>;
+		case Separation | Cohesion:
+			return &GetBoidSteering<Separation | Cohesion, bVectorized, bSameSpeciesOnly>;
+		default:
+			return &GetBoidSteering<EBoidsRuleMask::All, bVectorized, bSameSpeciesOnly>;
+		}
+	}
+
+	/** Pick the rule kernel specialized for a set of rules */
+	FGetBoidSteering SelectBoidSteering(const EBoidsRuleMask Rules, const bool bVectorized, const bool bSameSpeciesOnly)
+	{
+		if (bVectorized)
+		{
+			return bSameSpeciesOnly ? SelectBoidSteering<true, true>(Rules) : SelectBoidSteering<true, false>(Rules);
+		}
+
+		return bSameSpeciesOnly ? SelectBoidSteering<false, true>(Rules) : SelectBoidSteering<false, false>(Rules);
+	}
+}
+
+void BoidsCore::RunBoidsRules(const FBoidsGrid& Grid, const FBoidsRuleSettings& Settings, TArrayView<FVector> OutSteerings)
+{
+	RunBoidsRules(Grid, Settings, OutSteerings, TConstArrayView<int32>());
+}
+
+void BoidsCore::RunBoidsRules(const FBoidsGrid& Grid, const FBoidsRuleSettings& Settings, TArrayView<FVector> OutSteerings, TConstArrayView<int32> SortedBoids)
+{
+	RunBoidsRules(Grid, MakeArrayView(&Settings, 1), TConstArrayView<float>(), OutSteerings, SortedBoids);
+}
+
+void BoidsCore::RunBoidsRules(const FBoidsGrid& Grid, TConstArrayView<FBoidsRuleSettings> SpeciesSettings, TConstArrayView<float> SortedSpecies, TArrayView<FVector> OutSteerings, TConstArrayView<int32> SortedBoids)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_RunBoidsRules);
+
+	check(OutSteerings.Num() == Grid.Num());
+	check(SpeciesSettings.Num() > 0);
+
+	const bool bAllBoids = SortedBoids.Num() == 0;
+	const bool bMultipleSpecies = SpeciesSettings.Num() > 1;
+	check(!bMultipleSpecies || SortedSpecies.Num() == Grid.Num());
+
+	// Pick the kernel of every species once, the settings are not read again for each neighbor
+	TArray<FBoidsSpeciesRules, TInlineAllocator<8>> SpeciesRules;
+	for (const FBoidsRuleSettings& Settings : SpeciesSettings)
+	{
+		FBoidsSpeciesRules& Rules = SpeciesRules.AddDefaulted_GetRef();
+		Rules.Settings = Settings;
+		Rules.Distances.Alignment = Settings.AlignmentDistanceSquared;
+		Rules.Distances.Separation = Settings.SeparationDistanceSquared;
+		Rules.Distances.Cohesion = Settings.CohesionDistanceSquared;
+		Rules.GetSteering = SelectBoidSteering(Settings.GetEnabledRules(), Settings.bVectorized, bMultipleSpecies && !Settings.bFlockWithOtherSpecies);
+	}
+
+	const FBoidsRuleContext Context
+	{
+		Grid.GetSortedLocations(),
+		Grid.GetSortedVelocities(),
+		Grid.GetLayout(),
+		Grid.GetCellStart(),
+		Grid.GetCellCount(),
+		bMultipleSpecies ? SortedSpecies.GetData() : nullptr
+	};
+
+	const TArray<int32>& GridBoids = Grid.GetGridBoids();
+
+	// Run the boids in grid order so that boids next to each other read the same neighbors
+	ParallelFor(bAllBoids ? Grid.Num() : SortedBoids.Num(), [&] (int32 Ndx)
+	{
+		const int32 SortedNdx = bAllBoids ? Ndx : SortedBoids[Ndx];
+		const FBoidsSpeciesRules& Rules = SpeciesRules[bMultipleSpecies ? (int32)SortedSpecies[SortedNdx] : 0];
+
+		OutSteerings[GridBoids[SortedNdx]] = FVector(Rules.GetSteering(Context, Rules, SortedNdx));
+	});
+}
+
+void BoidsCore::SortBoidsSpecies(const FBoidsGrid& Grid, TConstArrayView<uint8> BoidsSpecies, TArrayView<float> OutSortedSpecies)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SortBoidsSpecies);
+
+	check(BoidsSpecies.Num() == Grid.Num() && OutSortedSpecies.Num() == Grid.Num());
+
+	const TArray<int32>& GridBoids = Grid.GetGridBoids();
+
+	ParallelFor(Grid.Num(), [&] (int32 SortedNdx)
+	{
+		OutSortedSpecies[SortedNdx] = BoidsSpecies[GridBoids[SortedNdx]];
+	});
+}
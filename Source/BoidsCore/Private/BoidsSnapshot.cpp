@@ -0,0 +1,217 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsSnapshot.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsSnapshot, Log, All);
+
+namespace
+{
+	constexpr uint32 SnapshotMagic = 0x504E5342; // 'BSNP'
+	constexpr uint32 SnapshotVersion = 1;
+
+	/** Every array of the file starts on this boundary, so that they can be read with vector loads in place */
+	constexpr int64 SnapshotAlignment = 16;
+
+	/** Magic, version, number of boids and number of species */
+	constexpr int64 SnapshotHeaderSize = 16;
+
+	/** Location, velocity and speed arrays */
+	constexpr int64 NumSnapshotFloatArrays = 7;
+
+	FORCEINLINE int64 GetSnapshotArrayStride(const int32 NumBoids)
+	{
+		return Align((int64)NumBoids * sizeof(float), SnapshotAlignment);
+	}
+
+	FORCEINLINE int64 GetSnapshotSize(const int32 NumBoids)
+	{
+		return SnapshotHeaderSize + NumSnapshotFloatArrays * GetSnapshotArrayStride(NumBoids) + NumBoids;
+	}
+}
+
+FBoidsSnapshot::FBoidsSnapshot() = default;
+
+FBoidsSnapshot::~FBoidsSnapshot()
+{
+	Reset();
+}
+
+bool FBoidsSnapshot::Save(const TCHAR* Filename, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, TConstArrayView<float> Speeds, TConstArrayView<uint8> Species)
+{
+	const int32 NumBoids = Locations.Num();
+	check(Velocities.Num() == NumBoids && Speeds.Num() == NumBoids && Species.Num() == NumBoids);
+
+	int32 NumSpecies = 0;
+	for (const uint8 BoidSpecies : Species)
+	{
+		NumSpecies = FMath::Max(NumSpecies, BoidSpecies + 1);
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Filename));
+
+	TUniquePtr<IFileHandle> File(PlatformFile.OpenWrite(Filename));
+	if (!File)
+	{
+		UE_LOG(LogBoidsSnapshot, Warning, TEXT("Could not open %s for writing"), Filename);
+		return false;
+	}
+
+	const uint32 Header[] = { SnapshotMagic, SnapshotVersion, (uint32)NumBoids, (uint32)NumSpecies };
+	static_assert(sizeof(Header) == SnapshotHeaderSize, "The header must keep the arrays aligned");
+
+	// The arrays are written straight from the buffers, only the padding between them is added
+	const uint8 Padding[SnapshotAlignment] = {};
+	const auto WriteArray = [&File, &Padding] (const void* ArrayData, const int64 Size)
+	{
+		const int64 PaddingSize = Align(Size, SnapshotAlignment) - Size;
+		return File->Write((const uint8*)ArrayData, Size) && (PaddingSize == 0 || File->Write(Padding, PaddingSize));
+	};
+
+	const int64 FloatArraySize = (int64)NumBoids * sizeof(float);
+	const bool bWritten = File->Write((const uint8*)Header, sizeof(Header))
+		&& WriteArray(Locations.X.GetData(), FloatArraySize)
+		&& WriteArray(Locations.Y.GetData(), FloatArraySize)
+		&& WriteArray(Locations.Z.GetData(), FloatArraySize)
+		&& WriteArray(Velocities.X.GetData(), FloatArraySize)
+		&& WriteArray(Velocities.Y.GetData(), FloatArraySize)
+		&& WriteArray(Velocities.Z.GetData(), FloatArraySize)
+		&& WriteArray(Speeds.GetData(), FloatArraySize)
+		&& File->Write(Species.GetData(), NumBoids)
+		&& File->Flush();
+
+	if (!bWritten)
+	{
+		UE_LOG(LogBoidsSnapshot, Warning, TEXT("Could not write %s"), Filename);
+	}
+
+	return bWritten;
+}
+
+bool FBoidsSnapshot::Open(const TCHAR* Filename)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsOpenSnapshot);
+
+	Reset();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	MappedFile.Reset(PlatformFile.OpenMapped(Filename));
+	if (MappedFile && MappedFile->GetFileSize() >= SnapshotHeaderSize)
+	{
+		MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	}
+
+	if (MappedRegion)
+	{
+		if (SetData(MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize()))
+		{
+			return true;
+		}
+	}
+	else if (FFileHelper::LoadFileToArray(LoadedData, Filename, FILEREAD_Silent))
+	{
+		// Not every platform can map files, the snapshot is read in memory instead
+		if (SetData(LoadedData.GetData(), LoadedData.Num()))
+		{
+			return true;
+		}
+	}
+
+	Reset();
+	return false;
+}
+
+bool FBoidsSnapshot::SetData(const uint8* InData, const int64 Size)
+{
+	if (Size < SnapshotHeaderSize || !IsAligned(InData, SnapshotAlignment))
+	{
+		return false;
+	}
+
+	uint32 Header[4];
+	FMemory::Memcpy(Header, InData, sizeof(Header));
+
+	const int32 LoadedNumBoids = (int32)Header[2];
+	const int32 LoadedNumSpecies = (int32)Header[3];
+	if (Header[0] != SnapshotMagic || Header[1] != SnapshotVersion || LoadedNumBoids < 0 || LoadedNumSpecies < 0 || LoadedNumSpecies > MAX_uint8 + 1
+		|| Size < GetSnapshotSize(LoadedNumBoids))
+	{
+		return false;
+	}
+
+	const int64 Stride = GetSnapshotArrayStride(LoadedNumBoids);
+	const uint8* Arrays = InData + SnapshotHeaderSize;
+	const uint8* LoadedSpecies = Arrays + NumSnapshotFloatArrays * Stride;
+
+	// Species index the entity types to spawn, so they are checked once here instead of by everything reading them
+	for (int32 Ndx = 0; Ndx < LoadedNumBoids; Ndx++)
+	{
+		if (LoadedSpecies[Ndx] >= LoadedNumSpecies)
+		{
+			return false;
+		}
+	}
+
+	Data = InData;
+	NumBoids = LoadedNumBoids;
+	NumSpecies = LoadedNumSpecies;
+
+	LocationX = (const float*)(Arrays);
+	LocationY = (const float*)(Arrays + Stride);
+	LocationZ = (const float*)(Arrays + Stride * 2);
+	VelocityX = (const float*)(Arrays + Stride * 3);
+	VelocityY = (const float*)(Arrays + Stride * 4);
+	VelocityZ = (const float*)(Arrays + Stride * 5);
+	Speeds = (const float*)(Arrays + Stride * 6);
+	Species = LoadedSpecies;
+
+	return true;
+}
+
+void FBoidsSnapshot::Reset()
+{
+	Data = nullptr;
+	NumBoids = 0;
+	NumSpecies = 0;
+
+	LocationX = LocationY = LocationZ = nullptr;
+	VelocityX = VelocityY = VelocityZ = nullptr;
+	Speeds = nullptr;
+	Species = nullptr;
+
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	LoadedData.Empty();
+}
+
+void FBoidsSnapshot::GetSpeciesBoids(TArray<TArray<int32>>& OutSpeciesBoids) const
+{
+	OutSpeciesBoids.Reset();
+	OutSpeciesBoids.SetNum(NumSpecies);
+
+	TArray<int32, TInlineAllocator<16>> SpeciesCounts;
+	SpeciesCounts.SetNumZeroed(NumSpecies);
+
+	for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+	{
+		SpeciesCounts[Species[Ndx]]++;
+	}
+
+	for (int32 SpeciesNdx = 0; SpeciesNdx < NumSpecies; SpeciesNdx++)
+	{
+		OutSpeciesBoids[SpeciesNdx].Reserve(SpeciesCounts[SpeciesNdx]);
+	}
+
+	for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+	{
+		OutSpeciesBoids[Species[Ndx]].Add(Ndx);
+	}
+}
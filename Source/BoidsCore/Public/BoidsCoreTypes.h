@@ -0,0 +1,126 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Float buffer aligned for vector loads */
+using FBoidsFloatBuffer = TArray<float, TAlignedHeapAllocator<16>>;
+
+/**
+ * Structure of arrays for a set of vectors. Used to keep boid data contiguous in memory while processing it
+ */
+struct FBoidsVectorSoA
+{
+	FBoidsFloatBuffer X;
+	FBoidsFloatBuffer Y;
+	FBoidsFloatBuffer Z;
+
+	/** Resize the buffers without giving back any memory. New elements are left uninitialized */
+	void SetNumUninitialized(const int32 Num)
+	{
+		X.SetNumUninitialized(Num, false);
+		Y.SetNumUninitialized(Num, false);
+		Z.SetNumUninitialized(Num, false);
+	}
+
+	FORCEINLINE int32 Num() const
+	{
+		return X.Num();
+	}
+
+	FORCEINLINE int32 Max() const
+	{
+		return X.Max();
+	}
+
+	FORCEINLINE FVector Get(const int32 Ndx) const
+	{
+		return FVector(X[Ndx], Y[Ndx], Z[Ndx]);
+	}
+
+	FORCEINLINE void Set(const int32 Ndx, const FVector& Value)
+	{
+		X[Ndx] = Value.X;
+		Y[Ndx] = Value.Y;
+		Z[Ndx] = Value.Z;
+	}
+};
+
+namespace BoidsCore
+{
+	/**
+	 * Resize a buffer that is reused every frame. Buffers never shrink, so they stop allocating once they reach their peak size.
+	 * NumAllocations is incremented every time the buffer has to grow.
+	 */
+	template<typename BufferType>
+	FORCEINLINE void ResizeBuffer(BufferType& Buffer, const int32 Num, uint32& NumAllocations)
+	{
+		NumAllocations += Num > Buffer.Max();
+		Buffer.SetNumUninitialized(Num, false);
+	}
+
+	FORCEINLINE void ResizeBuffer(FBoidsVectorSoA& Buffer, const int32 Num, uint32& NumAllocations)
+	{
+		NumAllocations += (Num > Buffer.Max()) * 3;
+		Buffer.SetNumUninitialized(Num);
+	}
+}
+
+/**
+ * Dimensions of the uniform 3D grid used to find nearby boids
+ */
+struct FBoidsGridLayout
+{
+	/** Bits of each axis in a Z-order cell index, FMath::MortonCode3 only interleaves the lowest ten bits of a coordinate */
+	static constexpr int32 MortonBitsPerAxis = 10;
+
+	/** Largest number of cells along each axis, any more and the Z-order indices of different cells would be the same */
+	static constexpr int32 MaxCellsPerAxis = 1 << MortonBitsPerAxis;
+
+	/** Minimum corner of the grid */
+	FVector3f Min = FVector3f::ZeroVector;
+
+	/** Inverse of the size of a single cell */
+	float InvCellSize = 0.f;
+
+	/** Number of cells along each axis */
+	FIntVector NumCells = FIntVector::ZeroValue;
+
+	/** Number of cell indices, larger than the number of cells when cells are ordered along a Z-order curve */
+	int32 NumCellIndices = 0;
+
+	/** If cells are ordered along a Z-order curve instead of row by row */
+	bool bMortonOrder = false;
+
+	FORCEINLINE int32 Num() const
+	{
+		return NumCellIndices;
+	}
+
+	FORCEINLINE bool operator==(const FBoidsGridLayout& Other) const
+	{
+		return Min == Other.Min && InvCellSize == Other.InvCellSize && NumCells == Other.NumCells && NumCellIndices == Other.NumCellIndices && bMortonOrder == Other.bMortonOrder;
+	}
+
+	/** Get the cell of a location. Locations outside of the grid are clamped to the border cells */
+	FORCEINLINE FIntVector GetCell(const float X, const float Y, const float Z) const
+	{
+		return FIntVector
+		(
+			(int32)FMath::Clamp((X - Min.X) * InvCellSize, 0.f, (float)(NumCells.X - 1)),
+			(int32)FMath::Clamp((Y - Min.Y) * InvCellSize, 0.f, (float)(NumCells.Y - 1)),
+			(int32)FMath::Clamp((Z - Min.Z) * InvCellSize, 0.f, (float)(NumCells.Z - 1))
+		);
+	}
+
+	FORCEINLINE int32 GetCellIndex(const FIntVector& Cell) const
+	{
+		if (bMortonOrder)
+		{
+			return (int32)(FMath::MortonCode3(Cell.X) | (FMath::MortonCode3(Cell.Y) << 1) | (FMath::MortonCode3(Cell.Z) << 2));
+		}
+
+		return (Cell.Z * NumCells.Y + Cell.Y) * NumCells.X + Cell.X;
+	}
+};
@@ -0,0 +1,149 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Signed distance to the closest obstacle, sampled on a low resolution grid covering a box. Distances are negative inside of obstacles.
+ * Locations are looked up with trilinear interpolation, locations outside of the box use the closest samples.
+ *
+ * The file format is small enough to load at startup, all values are little endian:
+ *   uint32 Magic ('BSDF'), uint32 Version,
+ *   FVector3f Min, FVector3f Max, FIntVector Resolution,
+ *   float MaxDistance, int16 Distances[Resolution.X * Resolution.Y * Resolution.Z]
+ * Distances are stored along X first and quantized to [-MaxDistance, MaxDistance].
+ */
+class BOIDSCORE_API FBoidsDistanceField
+{
+public:
+
+	/** Fill the field by evaluating a distance function at every sample. Each axis needs at least two samples */
+	void Build(const FBox& Bounds, const FIntVector& Resolution, TFunctionRef<float(const FVector&)> GetDistance);
+
+	/** Write the field in its file format */
+	void Save(TArray<uint8>& OutData) const;
+
+	/** Read a field written by Save. Returns false and leaves the field empty when the data is not a valid field */
+	bool Load(const TArray<uint8>& Data);
+
+	void Reset();
+
+	FORCEINLINE bool IsValid() const
+	{
+		return Distances.Num() > 0;
+	}
+
+	FORCEINLINE FBox GetBounds() const
+	{
+		return FBox(FVector(Min), FVector(Max));
+	}
+
+	FORCEINLINE const FIntVector& GetResolution() const
+	{
+		return Resolution;
+	}
+
+	/** Distance of each sample, along X first */
+	FORCEINLINE const TArray<float>& GetDistances() const
+	{
+		return Distances;
+	}
+
+	/** Get the distance to the closest obstacle at a location */
+	FORCEINLINE float GetDistance(const FVector& Location) const
+	{
+		FVector Gradient;
+		return GetDistanceAndGradient(Location, Gradient);
+	}
+
+	/** Get the distance to the closest obstacle at a location, and its gradient which points away from the obstacle */
+	FORCEINLINE float GetDistanceAndGradient(const FVector& Location, FVector& OutGradient) const
+	{
+		checkSlow(IsValid());
+
+		const FVector3f SampleCoords = (FVector3f(Location) - Min) * InvSampleSpacing;
+
+		int32 X, Y, Z;
+		float FracX, FracY, FracZ;
+		GetCellCoords(SampleCoords.X, Resolution.X, X, FracX);
+		GetCellCoords(SampleCoords.Y, Resolution.Y, Y, FracY);
+		GetCellCoords(SampleCoords.Z, Resolution.Z, Z, FracZ);
+
+		const int32 StrideY = Resolution.X;
+		const int32 StrideZ = Resolution.X * Resolution.Y;
+		const float* Corner = Distances.GetData() + X + Y * StrideY + Z * StrideZ;
+
+		const float D000 = Corner[0];
+		const float D100 = Corner[1];
+		const float D010 = Corner[StrideY];
+		const float D110 = Corner[StrideY + 1];
+		const float D001 = Corner[StrideZ];
+		const float D101 = Corner[StrideZ + 1];
+		const float D011 = Corner[StrideZ + StrideY];
+		const float D111 = Corner[StrideZ + StrideY + 1];
+
+		// Interpolate along X, then Y, then Z
+		const float D00 = FMath::Lerp(D000, D100, FracX);
+		const float D10 = FMath::Lerp(D010, D110, FracX);
+		const float D01 = FMath::Lerp(D001, D101, FracX);
+		const float D11 = FMath::Lerp(D011, D111, FracX);
+
+		const float D0 = FMath::Lerp(D00, D10, FracY);
+		const float D1 = FMath::Lerp(D01, D11, FracY);
+
+		// Derivative of the same interpolation along each axis
+		const float DX0 = FMath::Lerp(D100 - D000, D110 - D010, FracY);
+		const float DX1 = FMath::Lerp(D101 - D001, D111 - D011, FracY);
+
+		OutGradient.X = FMath::Lerp(DX0, DX1, FracZ) * InvSampleSpacing.X;
+		OutGradient.Y = FMath::Lerp(D10 - D00, D11 - D01, FracZ) * InvSampleSpacing.Y;
+		OutGradient.Z = (D1 - D0) * InvSampleSpacing.Z;
+
+		return FMath::Lerp(D0, D1, FracZ);
+	}
+
+private:
+
+	/** Get the cell of a sample coordinate and where it is in the cell, clamping coordinates outside of the field */
+	static FORCEINLINE void GetCellCoords(const float SampleCoord, const int32 NumSamples, int32& OutCell, float& OutFrac)
+	{
+		const float ClampedCoord = FMath::Clamp(SampleCoord, 0.f, (float)(NumSamples - 1));
+		OutCell = FMath::Min(FMath::FloorToInt(ClampedCoord), NumSamples - 2);
+		OutFrac = ClampedCoord - OutCell;
+	}
+
+	void UpdateSampleSpacing();
+
+	FVector3f Min = FVector3f::ZeroVector;
+	FVector3f Max = FVector3f::ZeroVector;
+
+	/** Number of samples along each axis */
+	FIntVector Resolution = FIntVector::ZeroValue;
+
+	/** Inverse of the distance between two samples along each axis */
+	FVector3f InvSampleSpacing = FVector3f::ZeroVector;
+
+	/** Distance of each sample, along X first */
+	TArray<float> Distances;
+};
+
+namespace BoidsCore
+{
+	/**
+	 * Get the steering that pushes a boid away from obstacles closer than AvoidDistance.
+	 * It grows from nothing at AvoidDistance to AvoidRate on the surface of the obstacle, and up to twice that inside of it
+	 */
+	FORCEINLINE FVector GetObstacleAvoidance(const FBoidsDistanceField& Field, const FVector& Location, const float AvoidDistance, const float AvoidRate)
+	{
+		FVector Gradient;
+		const float Distance = Field.GetDistanceAndGradient(Location, Gradient);
+		if (Distance >= AvoidDistance)
+		{
+			return FVector::ZeroVector;
+		}
+
+		const float Strength = FMath::Min(1.f - (Distance / AvoidDistance), 2.f);
+		return Gradient.GetSafeNormal() * (AvoidRate * Strength);
+	}
+}
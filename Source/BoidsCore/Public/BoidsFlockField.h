@@ -0,0 +1,209 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BoidsCoreTypes.h"
+
+/**
+ * Settings used to lay out the flock field
+ */
+struct FBoidsFlockFieldSettings
+{
+	/** Center of the field */
+	FVector3f Origin = FVector3f::ZeroVector;
+
+	/** Half of the size of the field along each axis */
+	float HalfSize = 0.f;
+
+	/** Number of nodes along each axis, at least two */
+	int32 NodesPerAxis = 16;
+};
+
+/**
+ * Weights of the steering from the flock field
+ */
+struct FBoidsFlockRuleSettings
+{
+	/** Rate at which boids turn towards denser parts of the flock */
+	float Cohesion = 0.f;
+
+	/** Weight of matching the mean velocity of the flock around a boid */
+	float Alignment = 0.f;
+
+	/** Smallest density of other boids, in boids, at which a boid is steered by the field */
+	float MinDensity = 1.f;
+};
+
+/**
+ * Density and velocity of the flock interpolated at a location
+ */
+struct FBoidsFlockSample
+{
+	/** Number of boids around the location, weighted by their distance in nodes */
+	float Density = 0.f;
+
+	/** Direction in which the density grows the fastest, per unit of distance */
+	FVector3f DensityGradient = FVector3f::ZeroVector;
+
+	/** Sum of the velocities of the boids around the location, with the same weights as the density */
+	FVector3f Velocity = FVector3f::ZeroVector;
+};
+
+/**
+ * Coarse grid of the density and velocity of all boids, for steering that reaches farther than the neighbors found through the boids grid.
+ * Every boid is splatted into the eight nodes around it with trilinear weights and read back with the same weights, so building and sampling
+ * the field costs the same no matter how far apart the boids are. Boids are splatted in blocks, each into its own copy of the nodes, and the
+ * copies are summed into the field afterwards so no node is written by two threads.
+ */
+class BOIDSCORE_API FBoidsFlockField
+{
+public:
+
+	/** Splat the boids into the field, replacing the boids of the last build */
+	void Build(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsFlockFieldSettings& Settings);
+
+	FORCEINLINE bool IsValid() const
+	{
+		return Nodes.Num() > 0;
+	}
+
+	FORCEINLINE int32 GetNodesPerAxis() const
+	{
+		return NodesPerAxis;
+	}
+
+	/** Get the density and velocity of the flock at a location. Locations outside of the field use the closest nodes */
+	FORCEINLINE FBoidsFlockSample Sample(const FVector3f& Location) const
+	{
+		FBoidsFlockSample Sample;
+		float SelfWeight;
+		SampleInternal(Location, Sample, SelfWeight);
+		return Sample;
+	}
+
+	/**
+	 * Get the density and velocity of the flock at the location of a boid that was splatted into the field, without the boid itself.
+	 * A boid alone in the field gets an empty sample
+	 */
+	FORCEINLINE FBoidsFlockSample SampleOthers(const FVector3f& Location, const FVector3f& Velocity) const
+	{
+		FBoidsFlockSample Sample;
+		float SelfWeight;
+		const FVector3f Frac = SampleInternal(Location, Sample, SelfWeight);
+
+		// The boid was splatted with the same weights it reads the nodes with, so its share of the density is the sum of the squared weights
+		// and its share of the gradient is the sum of the weights times their derivatives, both of which factor per axis
+		const FVector3f SquaredWeights = FVector3f(1.f) - Frac * 2.f + Frac * Frac * 2.f;
+		const FVector3f WeightDerivatives = (Frac * 2.f - FVector3f(1.f)) * InvNodeSpacing;
+
+		Sample.Density -= SelfWeight;
+		Sample.DensityGradient -= FVector3f
+		(
+			WeightDerivatives.X * SquaredWeights.Y * SquaredWeights.Z,
+			SquaredWeights.X * WeightDerivatives.Y * SquaredWeights.Z,
+			SquaredWeights.X * SquaredWeights.Y * WeightDerivatives.Z
+		);
+		Sample.Velocity -= Velocity * SelfWeight;
+
+		return Sample;
+	}
+
+	/** Number of times a buffer had to grow during the last build */
+	FORCEINLINE uint32 GetNumBufferAllocations() const
+	{
+		return NumBufferAllocations;
+	}
+
+private:
+
+	/** Density and summed velocity of a node */
+	struct FNode
+	{
+		FVector3f Velocity;
+		float Density;
+	};
+
+	/** Get the node below a coordinate in nodes, and how far the coordinate is past it */
+	FORCEINLINE void GetNodeCoords(const float Coord, int32& OutNode, float& OutFrac) const
+	{
+		const float Clamped = FMath::Clamp(Coord, 0.f, (float)(NodesPerAxis - 1));
+		OutNode = FMath::Min((int32)Clamped, NodesPerAxis - 2);
+		OutFrac = Clamped - (float)OutNode;
+	}
+
+	/** Interpolate the eight nodes around a location. Returns where the location is between them, and the sum of the squared weights */
+	FORCEINLINE FVector3f SampleInternal(const FVector3f& Location, FBoidsFlockSample& OutSample, float& OutSelfWeight) const
+	{
+		checkSlow(IsValid());
+
+		const FVector3f NodeCoords = (Location - Min) * InvNodeSpacing;
+
+		int32 X, Y, Z;
+		FVector3f Frac;
+		GetNodeCoords(NodeCoords.X, X, Frac.X);
+		GetNodeCoords(NodeCoords.Y, Y, Frac.Y);
+		GetNodeCoords(NodeCoords.Z, Z, Frac.Z);
+
+		const int32 StrideY = NodesPerAxis;
+		const int32 StrideZ = NodesPerAxis * NodesPerAxis;
+		const FNode* Corner = Nodes.GetData() + X + Y * StrideY + Z * StrideZ;
+
+		OutSelfWeight = 0.f;
+
+		for (int32 CornerNdx = 0; CornerNdx < 8; CornerNdx++)
+		{
+			const int32 OffsetX = CornerNdx & 1;
+			const int32 OffsetY = (CornerNdx >> 1) & 1;
+			const int32 OffsetZ = (CornerNdx >> 2) & 1;
+
+			const FNode& Node = Corner[OffsetX + OffsetY * StrideY + OffsetZ * StrideZ];
+
+			const float WeightX = OffsetX ? Frac.X : 1.f - Frac.X;
+			const float WeightY = OffsetY ? Frac.Y : 1.f - Frac.Y;
+			const float WeightZ = OffsetZ ? Frac.Z : 1.f - Frac.Z;
+			const float Weight = WeightX * WeightY * WeightZ;
+
+			// Derivative of the weight along each axis, the weight along the other two axes stays the same
+			const FVector3f WeightGradient = FVector3f
+			(
+				(OffsetX ? 1.f : -1.f) * WeightY * WeightZ,
+				(OffsetY ? 1.f : -1.f) * WeightX * WeightZ,
+				(OffsetZ ? 1.f : -1.f) * WeightX * WeightY
+			) * InvNodeSpacing;
+
+			OutSample.Density += Node.Density * Weight;
+			OutSample.DensityGradient += WeightGradient * Node.Density;
+			OutSample.Velocity += Node.Velocity * Weight;
+			OutSelfWeight += Weight * Weight;
+		}
+
+		return Frac;
+	}
+
+	/** Location of the first node */
+	FVector3f Min = FVector3f::ZeroVector;
+
+	/** Inverse of the distance between two nodes */
+	float InvNodeSpacing = 0.f;
+
+	int32 NodesPerAxis = 0;
+
+	/** Nodes along X first */
+	TArray<FNode> Nodes;
+
+	/** Copy of the nodes for each block of boids, summed into the nodes once every boid is splatted */
+	TArray<FNode> BlockNodes;
+
+	/** Number of times a buffer had to grow during the last build */
+	uint32 NumBufferAllocations = 0;
+};
+
+namespace BoidsCore
+{
+	/**
+	 * Add the steering of the flock field to the steering of every boid, which is in the same order as the boids the field was built from.
+	 * Boids turn towards denser parts of the flock and match the mean velocity around them, leaving themselves out of both.
+	 */
+	BOIDSCORE_API void AddFlockSteering(const FBoidsFlockField& Field, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsFlockRuleSettings& Settings, TArrayView<FVector> InOutSteerings);
+}
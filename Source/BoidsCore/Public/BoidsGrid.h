@@ -0,0 +1,160 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BoidsCoreTypes.h"
+
+/**
+ * Settings used to lay out and maintain the boids grid
+ */
+struct FBoidsGridSettings
+{
+	/** Center of the grid */
+	FVector3f Origin = FVector3f::ZeroVector;
+
+	/** Half of the size of the grid along each axis */
+	float HalfSize = 0.f;
+
+	/** Largest distance between two boids that must be found through the grid */
+	float MaxDistance = 0.f;
+
+	/** Maximum number of cells along each axis, clamped to FBoidsGridLayout::MaxCellsPerAxis */
+	int32 MaxCellsPerAxis = 32;
+
+	/** If cells are ordered along a Z-order curve instead of row by row */
+	bool bMortonOrder = false;
+
+	/** If the grid of the last frame can be updated instead of rebuilt */
+	bool bIncremental = true;
+
+	/** Fraction of boids that can change cells before the grid is rebuilt instead of updated */
+	float RebuildThreshold = 0.05f;
+};
+
+/**
+ * Uniform 3D grid of boids, with a copy of their locations and velocities sorted by cell.
+ * All buffers are kept between frames and the grid of the last frame is updated when few boids changed cells.
+ */
+class BOIDSCORE_API FBoidsGrid
+{
+public:
+
+	/**
+	 * Sort the boids in their cells.
+	 * When bReordered is set the boids are expected to be in the sorted order of the last call, as given by GetBoidsGridSlot.
+	 */
+	void Setup(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsGridSettings& Settings, const bool bReordered);
+
+	/** Forget the grid of the last frame so that the next setup rebuilds it */
+	void Invalidate()
+	{
+		bPrevGridValid = false;
+	}
+
+	FORCEINLINE int32 Num() const
+	{
+		return GridBoids.Num();
+	}
+
+	FORCEINLINE const FBoidsGridLayout& GetLayout() const
+	{
+		return GridLayout;
+	}
+
+	/** Boid indices sorted by grid cell */
+	FORCEINLINE const TArray<int32>& GetGridBoids() const
+	{
+		return GridBoids;
+	}
+
+	/** Position of each boid in the sorted order */
+	FORCEINLINE const TArray<int32>& GetBoidsGridSlot() const
+	{
+		return BoidsGridSlot;
+	}
+
+	/** Locations and velocities in the sorted order, so the boids of a cell are contiguous */
+	FORCEINLINE const FBoidsVectorSoA& GetSortedLocations() const
+	{
+		return SortedLocations;
+	}
+
+	FORCEINLINE const FBoidsVectorSoA& GetSortedVelocities() const
+	{
+		return SortedVelocities;
+	}
+
+	/** Where the boids of each cell start in the sorted order and how many there are */
+	FORCEINLINE const TArray<int32>& GetCellStart() const
+	{
+		return GridCellStart;
+	}
+
+	FORCEINLINE const TArray<int32>& GetCellCount() const
+	{
+		return GridCellCount;
+	}
+
+	/** Number of times a buffer had to grow during the last setup */
+	FORCEINLINE uint32 GetNumBufferAllocations() const
+	{
+		return NumBufferAllocations;
+	}
+
+private:
+
+	void UpdateGridLayout(const FBoidsGridSettings& Settings);
+	void BuildGrid(const int32 NumBoids, const int32 NumBlocks, const int32 BlockSize);
+	void UpdateGrid(const int32 NumBoids, const int32 NumBlocks, const int32 BlockSize, const int32 NumMovers);
+
+	/** Dimensions of the grid for the current frame */
+	FBoidsGridLayout GridLayout;
+
+	/** Grid cell of each boid */
+	TArray<int32> BoidsGridIndex;
+
+	/** Boid indices sorted by grid cell */
+	TArray<int32> GridBoids;
+
+	/** Position of each boid in GridBoids */
+	TArray<int32> BoidsGridSlot;
+
+	/** Grid cell of each boid in GridBoids order */
+	TArray<int32> SortedGridIndex;
+
+	/** Locations and velocities in the same order as GridBoids, so the boids of a cell are contiguous */
+	FBoidsVectorSoA SortedLocations;
+	FBoidsVectorSoA SortedVelocities;
+
+	/** Where the boids of each cell start in GridBoids and how many there are */
+	TArray<int32> GridCellStart;
+	TArray<int32> GridCellCount;
+
+	/** Number of boids per cell for each block of boids, turned into write offsets when building the grid */
+	TArray<int32> GridBlockOffsets;
+
+	/** Grid of the previous frame, used to update the grid instead of rebuilding it */
+	TArray<int32> PrevGridBoids;
+	TArray<int32> PrevBoidsGridSlot;
+	TArray<int32> PrevSortedGridIndex;
+	TArray<int32> PrevGridCellStart;
+	TArray<int32> PrevGridCellCount;
+
+	/** Number of boids that changed cells in each block, turned into write offsets when updating the grid */
+	TArray<int32> GridBlockMovers;
+
+	/** Boids that changed cells this frame, in boid order and sorted by their new cell */
+	TArray<int32> GridMovers;
+	TArray<int32> GridArrivals;
+
+	/** If the boids are in the sorted order of the last frame */
+	bool bReorderedBoids = false;
+
+	/** If the previous grid can be updated and if the boids were reordered when it was built */
+	bool bPrevGridValid = false;
+	bool bPrevGridReordered = false;
+
+	/** Number of times a buffer had to grow during the last setup */
+	uint32 NumBufferAllocations = 0;
+};
@@ -0,0 +1,51 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace BoidsCore
+{
+	/** Get the steering that turns a boid back towards the bounds when it is outside of them */
+	FORCEINLINE FVector GetTurnBack(const FVector& Location, const FBox& Bounds, const float TurnRate)
+	{
+		FVector TurnBack = FVector::ZeroVector;
+
+		const bool bMinX = Location.X < Bounds.Min.X;
+		const bool bMinY = Location.Y < Bounds.Min.Y;
+		const bool bMinZ = Location.Z < Bounds.Min.Z;
+
+		// Turn back if outside minimum bounds
+		if (bMinX || bMinY || bMinZ)
+		{
+			TurnBack.X += TurnRate * bMinX;
+			TurnBack.Y += TurnRate * bMinY;
+			TurnBack.Z += TurnRate * bMinZ;
+		}
+
+		const bool bMaxX = Location.X > Bounds.Max.X;
+		const bool bMaxY = Location.Y > Bounds.Max.Y;
+		const bool bMaxZ = Location.Z > Bounds.Max.Z;
+
+		// Turn back if outside maximum bounds
+		if (bMaxX || bMaxY || bMaxZ)
+		{
+			TurnBack.X -= TurnRate * bMaxX;
+			TurnBack.Y -= TurnRate * bMaxY;
+			TurnBack.Z -= TurnRate * bMaxZ;
+		}
+
+		return TurnBack;
+	}
+
+	/** Apply the steering to the velocity of a boid, limit it to the boid speed and move the boid */
+	FORCEINLINE void MoveBoid(FVector& Location, FVector& Velocity, const FVector& Steering, const float MaxSpeed, const float DeltaTime)
+	{
+		// Apply the steering of the rules and bounds
+		Velocity += Steering;
+		// Limit speed to MaxSpeed
+		Velocity = (Velocity / Velocity.Size()) * MaxSpeed;
+		// Update the location based on Velocity
+		Location += Velocity * DeltaTime;
+	}
+}
@@ -0,0 +1,124 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace BoidsCore
+{
+	/**
+	 * Get the half angle of an angle in (-PI, PI] from its cosine and sine, without trigonometric functions.
+	 * Picks the formula that does not divide by a small value.
+	 */
+	FORCEINLINE void GetHalfAngle(const float Cos, const float Sin, float& OutHalfCos, float& OutHalfSin)
+	{
+		if (Cos >= 0.f)
+		{
+			OutHalfCos = FMath::Sqrt((1.f + Cos) * 0.5f);
+			OutHalfSin = Sin / (2.f * OutHalfCos);
+		}
+		else
+		{
+			OutHalfSin = FMath::Sqrt((1.f - Cos) * 0.5f) * (Sin >= 0.f ? 1.f : -1.f);
+			OutHalfCos = Sin / (2.f * OutHalfSin);
+		}
+	}
+
+	/**
+	 * Get the rotation of a boid mesh from its velocity. The meshes point up, so this is the same rotation as
+	 * (Velocity.Rotation() - FRotator(90, 0, 0)).Quaternion(), but it only takes square roots instead of trigonometric functions
+	 */
+	FORCEINLINE FQuat GetHeadingRotation(const FVector& Velocity)
+	{
+		const float X = Velocity.X;
+		const float Y = Velocity.Y;
+		const float Z = Velocity.Z;
+
+		const float HorizontalSizeSquared = X * X + Y * Y;
+		const float SizeSquared = HorizontalSizeSquared + Z * Z;
+
+		// Same as FVector::Rotation, a zero velocity faces along X
+		if (SizeSquared < SMALL_NUMBER)
+		{
+			return FQuat(0.f, HALF_SQRT_2, 0.f, HALF_SQRT_2);
+		}
+
+		const float HorizontalSize = FMath::Sqrt(HorizontalSizeSquared);
+		const float InvSize = FMath::InvSqrt(SizeSquared);
+
+		// Yaw of the velocity
+		float YawCos = 1.f;
+		float YawSin = 0.f;
+		if (HorizontalSize > SMALL_NUMBER)
+		{
+			YawCos = X / HorizontalSize;
+			YawSin = Y / HorizontalSize;
+		}
+
+		// Pitch of the velocity minus 90 degrees
+		const float PitchCos = Z * InvSize;
+		const float PitchSin = -HorizontalSize * InvSize;
+
+		float CY, SY, CP, SP;
+		GetHalfAngle(YawCos, YawSin, CY, SY);
+		GetHalfAngle(PitchCos, PitchSin, CP, SP);
+
+		// FRotator::Quaternion without roll
+		return FQuat(SP * SY, -SP * CY, CP * SY, CP * CY);
+	}
+
+	/** Number of values per axis of a packed heading */
+	constexpr int32 PackedHeadingSteps = 4096;
+
+	/**
+	 * Pack the direction of a velocity in a single float, for per-instance custom data.
+	 * The direction is mapped on an octahedron and both of its coordinates are stored in 12 bits, as an integer a float holds exactly:
+	 *   Packed = U * 4096 + V, with U and V in [0, 4095] mapping to [-1, 1]
+	 * The material decodes it with U = floor(Packed / 4096), V = Packed - U * 4096, and unfolds the octahedron like UnpackHeading.
+	 */
+	FORCEINLINE float PackHeading(const FVector& Velocity)
+	{
+		const float L1Size = FMath::Abs(Velocity.X) + FMath::Abs(Velocity.Y) + FMath::Abs(Velocity.Z);
+		if (L1Size < SMALL_NUMBER)
+		{
+			// Same as FVector::Rotation, a zero velocity faces along X
+			return (float)((PackedHeadingSteps - 1) * PackedHeadingSteps + (PackedHeadingSteps / 2));
+		}
+
+		float U = Velocity.X / L1Size;
+		float V = Velocity.Y / L1Size;
+
+		// Fold the lower half of the octahedron over the upper half
+		if (Velocity.Z < 0.f)
+		{
+			const float FoldedU = (1.f - FMath::Abs(V)) * (U >= 0.f ? 1.f : -1.f);
+			const float FoldedV = (1.f - FMath::Abs(U)) * (V >= 0.f ? 1.f : -1.f);
+			U = FoldedU;
+			V = FoldedV;
+		}
+
+		const int32 PackedU = FMath::Clamp(FMath::RoundToInt((U * 0.5f + 0.5f) * (PackedHeadingSteps - 1)), 0, PackedHeadingSteps - 1);
+		const int32 PackedV = FMath::Clamp(FMath::RoundToInt((V * 0.5f + 0.5f) * (PackedHeadingSteps - 1)), 0, PackedHeadingSteps - 1);
+
+		return (float)(PackedU * PackedHeadingSteps + PackedV);
+	}
+
+	/** Get the unit direction of a heading packed by PackHeading */
+	FORCEINLINE FVector UnpackHeading(const float Packed)
+	{
+		const int32 PackedInt = (int32)Packed;
+		const float U = (PackedInt / PackedHeadingSteps) / (float)(PackedHeadingSteps - 1) * 2.f - 1.f;
+		const float V = (PackedInt % PackedHeadingSteps) / (float)(PackedHeadingSteps - 1) * 2.f - 1.f;
+
+		FVector Direction(U, V, 1.f - FMath::Abs(U) - FMath::Abs(V));
+
+		// Unfold the lower half of the octahedron
+		if (Direction.Z < 0.f)
+		{
+			Direction.X = (1.f - FMath::Abs(V)) * (U >= 0.f ? 1.f : -1.f);
+			Direction.Y = (1.f - FMath::Abs(U)) * (V >= 0.f ? 1.f : -1.f);
+		}
+
+		return Direction.GetSafeNormal();
+	}
+}
@@ -0,0 +1,284 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BoidsCoreTypes.h"
+#include "Math/VectorRegister.h"
+
+class FBoidsGrid;
+
+/**
+ * Set of boid rules, used to pick the rule kernels that only run the enabled rules
+ */
+enum class EBoidsRuleMask : uint8
+{
+	None = 0,
+	Alignment = 1 << 0,
+	Separation = 1 << 1,
+	Cohesion = 1 << 2,
+	All = Alignment | Separation | Cohesion
+};
+
+ENUM_CLASS_FLAGS(EBoidsRuleMask);
+
+/**
+ * Weights and distances of the boid rules
+ */
+struct FBoidsRuleSettings
+{
+	/** Weight of each rule */
+	float Alignment = 0.f;
+	float Separation = 0.f;
+	float Cohesion = 0.f;
+
+	/** Squared distance within which other boids count for each rule */
+	float AlignmentDistanceSquared = 0.f;
+	float SeparationDistanceSquared = 0.f;
+	float CohesionDistanceSquared = 0.f;
+
+	/** If the neighbors are tested four at a time */
+	bool bVectorized = true;
+
+	/** If alignment and cohesion count boids of every species, or only boids of the same species. Separation always counts every boid */
+	bool bFlockWithOtherSpecies = true;
+
+	/** Get the rules that change the steering, a rule without weight or without distance never does */
+	FORCEINLINE EBoidsRuleMask GetEnabledRules() const
+	{
+		EBoidsRuleMask Rules = EBoidsRuleMask::None;
+		if (Alignment != 0.f && AlignmentDistanceSquared > 0.f)
+		{
+			Rules |= EBoidsRuleMask::Alignment;
+		}
+		if (Separation != 0.f && SeparationDistanceSquared > 0.f)
+		{
+			Rules |= EBoidsRuleMask::Separation;
+		}
+		if (Cohesion != 0.f && CohesionDistanceSquared > 0.f)
+		{
+			Rules |= EBoidsRuleMask::Cohesion;
+		}
+		return Rules;
+	}
+};
+
+namespace BoidsCore
+{
+	/** Squared distances of each rule */
+	struct FBoidsRuleDistances
+	{
+		float Alignment;
+		float Separation;
+		float Cohesion;
+	};
+
+	/** Species of a boid and of the sorted boids, for boids that only flock with their own species */
+	struct FBoidsSpeciesFilter
+	{
+		/** Species of each sorted boid */
+		const float* Species = nullptr;
+
+		/** Species of the boid running the rules */
+		float BoidSpecies = 0.f;
+	};
+
+	/** Running sums of the rules for a single boid */
+	struct FBoidsRuleSums
+	{
+		FVector3f Alignment = FVector3f::ZeroVector;
+		FVector3f Separation = FVector3f::ZeroVector;
+		FVector3f Cohesion = FVector3f::ZeroVector;
+		float NumAlignment = 0.f;
+		float NumCohesion = 0.f;
+	};
+
+	FORCEINLINE float VectorHorizontalSum(const VectorRegister4Float& Vector)
+	{
+		alignas(16) float Values[4];
+		VectorStoreAligned(Vector, Values);
+		return (Values[0] + Values[1]) + (Values[2] + Values[3]);
+	}
+
+	/**
+	 * Accumulate the rules of a boid against a range of sorted boids, one boid at a time.
+	 * Only the rules in the mask are accumulated, the sums of the others stay untouched.
+	 * With bSameSpeciesOnly, boids of other species in the filter only count for separation
+	 */
+	template<EBoidsRuleMask Rules = EBoidsRuleMask::All, bool bSameSpeciesOnly = false>
+	FORCEINLINE void AccumulateBoidRules(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FVector3f& Location, const FBoidsRuleDistances& Distances, const int32 Start, const int32 End, FBoidsRuleSums& Sums, const FBoidsSpeciesFilter& Filter = FBoidsSpeciesFilter())
+	{
+		const bool bAlignment = EnumHasAnyFlags(Rules, EBoidsRuleMask::Alignment);
+		const bool bSeparation = EnumHasAnyFlags(Rules, EBoidsRuleMask::Separation);
+		const bool bCohesion = EnumHasAnyFlags(Rules, EBoidsRuleMask::Cohesion);
+
+		for (int32 OtherNdx = Start; OtherNdx < End; OtherNdx++)
+		{
+			const FVector3f OtherLocation(Locations.X[OtherNdx], Locations.Y[OtherNdx], Locations.Z[OtherNdx]);
+			const FVector3f Delta = Location - OtherLocation;
+			const float DistSquared = Delta.SizeSquared();
+
+			if (bSeparation && DistSquared < Distances.Separation)
+			{
+				Sums.Separation += Delta;
+			}
+
+			if (bSameSpeciesOnly && Filter.Species[OtherNdx] != Filter.BoidSpecies)
+			{
+				continue;
+			}
+
+			if (bAlignment && DistSquared < Distances.Alignment)
+			{
+				Sums.Alignment += OtherLocation;
+				Sums.NumAlignment += 1.f;
+			}
+
+			if (bCohesion && DistSquared < Distances.Cohesion)
+			{
+				Sums.Cohesion += FVector3f(Velocities.X[OtherNdx], Velocities.Y[OtherNdx], Velocities.Z[OtherNdx]);
+				Sums.NumCohesion += 1.f;
+			}
+		}
+	}
+
+	/**
+	 * Accumulate the rules of a boid against a range of sorted boids, four boids at a time using masks instead of branches.
+	 * Only the rules in the mask are accumulated, the sums of the others stay untouched.
+	 * With bSameSpeciesOnly, boids of other species in the filter only count for separation
+	 */
+	template<EBoidsRuleMask Rules = EBoidsRuleMask::All, bool bSameSpeciesOnly = false>
+	FORCEINLINE void AccumulateBoidRulesVectorized(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FVector3f& Location, const FBoidsRuleDistances& Distances, const int32 Start, const int32 End, FBoidsRuleSums& Sums, const FBoidsSpeciesFilter& Filter = FBoidsSpeciesFilter())
+	{
+		const bool bAlignment = EnumHasAnyFlags(Rules, EBoidsRuleMask::Alignment);
+		const bool bSeparation = EnumHasAnyFlags(Rules, EBoidsRuleMask::Separation);
+		const bool bCohesion = EnumHasAnyFlags(Rules, EBoidsRuleMask::Cohesion);
+
+		const float* RESTRICT LocationsX = Locations.X.GetData();
+		const float* RESTRICT LocationsY = Locations.Y.GetData();
+		const float* RESTRICT LocationsZ = Locations.Z.GetData();
+		const float* RESTRICT VelocitiesX = Velocities.X.GetData();
+		const float* RESTRICT VelocitiesY = Velocities.Y.GetData();
+		const float* RESTRICT VelocitiesZ = Velocities.Z.GetData();
+
+		const VectorRegister4Float LocationX = VectorSetFloat1(Location.X);
+		const VectorRegister4Float LocationY = VectorSetFloat1(Location.Y);
+		const VectorRegister4Float LocationZ = VectorSetFloat1(Location.Z);
+
+		const VectorRegister4Float AlignmentDistance = VectorSetFloat1(Distances.Alignment);
+		const VectorRegister4Float SeparationDistance = VectorSetFloat1(Distances.Separation);
+		const VectorRegister4Float CohesionDistance = VectorSetFloat1(Distances.Cohesion);
+		const VectorRegister4Float One = GlobalVectorConstants::FloatOne;
+		const VectorRegister4Float BoidSpecies = VectorSetFloat1(Filter.BoidSpecies);
+
+		VectorRegister4Float AlignmentX = VectorZeroFloat();
+		VectorRegister4Float AlignmentY = VectorZeroFloat();
+		VectorRegister4Float AlignmentZ = VectorZeroFloat();
+		VectorRegister4Float SeparationX = VectorZeroFloat();
+		VectorRegister4Float SeparationY = VectorZeroFloat();
+		VectorRegister4Float SeparationZ = VectorZeroFloat();
+		VectorRegister4Float CohesionX = VectorZeroFloat();
+		VectorRegister4Float CohesionY = VectorZeroFloat();
+		VectorRegister4Float CohesionZ = VectorZeroFloat();
+		VectorRegister4Float NumAlignment = VectorZeroFloat();
+		VectorRegister4Float NumCohesion = VectorZeroFloat();
+
+		int32 OtherNdx = Start;
+		for (; OtherNdx + 4 <= End; OtherNdx += 4)
+		{
+			const VectorRegister4Float OtherX = VectorLoad(LocationsX + OtherNdx);
+			const VectorRegister4Float OtherY = VectorLoad(LocationsY + OtherNdx);
+			const VectorRegister4Float OtherZ = VectorLoad(LocationsZ + OtherNdx);
+
+			const VectorRegister4Float DeltaX = VectorSubtract(LocationX, OtherX);
+			const VectorRegister4Float DeltaY = VectorSubtract(LocationY, OtherY);
+			const VectorRegister4Float DeltaZ = VectorSubtract(LocationZ, OtherZ);
+			const VectorRegister4Float DistSquared = VectorMultiplyAdd(DeltaZ, DeltaZ, VectorMultiplyAdd(DeltaY, DeltaY, VectorMultiply(DeltaX, DeltaX)));
+
+			// Boids of other species are masked out of the rules that only count the same species
+			VectorRegister4Float SpeciesMask = VectorZeroFloat();
+			if (bSameSpeciesOnly)
+			{
+				SpeciesMask = VectorCompareEQ(VectorLoad(Filter.Species + OtherNdx), BoidSpecies);
+			}
+
+			if (bAlignment)
+			{
+				VectorRegister4Float AlignmentMask = VectorCompareLT(DistSquared, AlignmentDistance);
+				if (bSameSpeciesOnly)
+				{
+					AlignmentMask = VectorBitwiseAnd(AlignmentMask, SpeciesMask);
+				}
+
+				AlignmentX = VectorAdd(AlignmentX, VectorBitwiseAnd(AlignmentMask, OtherX));
+				AlignmentY = VectorAdd(AlignmentY, VectorBitwiseAnd(AlignmentMask, OtherY));
+				AlignmentZ = VectorAdd(AlignmentZ, VectorBitwiseAnd(AlignmentMask, OtherZ));
+				NumAlignment = VectorAdd(NumAlignment, VectorBitwiseAnd(AlignmentMask, One));
+			}
+
+			if (bSeparation)
+			{
+				const VectorRegister4Float SeparationMask = VectorCompareLT(DistSquared, SeparationDistance);
+				SeparationX = VectorAdd(SeparationX, VectorBitwiseAnd(SeparationMask, DeltaX));
+				SeparationY = VectorAdd(SeparationY, VectorBitwiseAnd(SeparationMask, DeltaY));
+				SeparationZ = VectorAdd(SeparationZ, VectorBitwiseAnd(SeparationMask, DeltaZ));
+			}
+
+			if (bCohesion)
+			{
+				VectorRegister4Float CohesionMask = VectorCompareLT(DistSquared, CohesionDistance);
+				if (bSameSpeciesOnly)
+				{
+					CohesionMask = VectorBitwiseAnd(CohesionMask, SpeciesMask);
+				}
+
+				CohesionX = VectorAdd(CohesionX, VectorBitwiseAnd(CohesionMask, VectorLoad(VelocitiesX + OtherNdx)));
+				CohesionY = VectorAdd(CohesionY, VectorBitwiseAnd(CohesionMask, VectorLoad(VelocitiesY + OtherNdx)));
+				CohesionZ = VectorAdd(CohesionZ, VectorBitwiseAnd(CohesionMask, VectorLoad(VelocitiesZ + OtherNdx)));
+				NumCohesion = VectorAdd(NumCohesion, VectorBitwiseAnd(CohesionMask, One));
+			}
+		}
+
+		if (bAlignment)
+		{
+			Sums.Alignment += FVector3f(VectorHorizontalSum(AlignmentX), VectorHorizontalSum(AlignmentY), VectorHorizontalSum(AlignmentZ));
+			Sums.NumAlignment += VectorHorizontalSum(NumAlignment);
+		}
+
+		if (bSeparation)
+		{
+			Sums.Separation += FVector3f(VectorHorizontalSum(SeparationX), VectorHorizontalSum(SeparationY), VectorHorizontalSum(SeparationZ));
+		}
+
+		if (bCohesion)
+		{
+			Sums.Cohesion += FVector3f(VectorHorizontalSum(CohesionX), VectorHorizontalSum(CohesionY), VectorHorizontalSum(CohesionZ));
+			Sums.NumCohesion += VectorHorizontalSum(NumCohesion);
+		}
+
+		// Remaining boids that do not fill a vector
+		AccumulateBoidRules<Rules, bSameSpeciesOnly>(Locations, Velocities, Location, Distances, OtherNdx, End, Sums, Filter);
+	}
+
+	/**
+	 * Get the combined steering of all rules for every boid in the grid.
+	 * Steerings are written in boid order, not in the sorted order of the grid.
+	 */
+	BOIDSCORE_API void RunBoidsRules(const FBoidsGrid& Grid, const FBoidsRuleSettings& Settings, TArrayView<FVector> OutSteerings);
+
+	/**
+	 * Get the combined steering of all rules for a subset of the boids, given by their ascending positions in the sorted order of the grid.
+	 * The steerings of the other boids are left untouched. An empty subset runs every boid.
+	 */
+	BOIDSCORE_API void RunBoidsRules(const FBoidsGrid& Grid, const FBoidsRuleSettings& Settings, TArrayView<FVector> OutSteerings, TConstArrayView<int32> SortedBoids);
+
+	/**
+	 * Get the combined steering of all rules for a subset of the boids, each with the rules of its species.
+	 * SortedSpecies is the species of every boid in the sorted order of the grid, as an index into SpeciesSettings.
+	 * It is not needed when there is a single species. An empty subset runs every boid.
+	 */
+	BOIDSCORE_API void RunBoidsRules(const FBoidsGrid& Grid, TConstArrayView<FBoidsRuleSettings> SpeciesSettings, TConstArrayView<float> SortedSpecies, TArrayView<FVector> OutSteerings, TConstArrayView<int32> SortedBoids);
+
+	/** Put the species of each boid, given in boid order, in the sorted order of the grid */
+	BOIDSCORE_API void SortBoidsSpecies(const FBoidsGrid& Grid, TConstArrayView<uint8> BoidsSpecies, TArrayView<float> OutSortedSpecies);
+}
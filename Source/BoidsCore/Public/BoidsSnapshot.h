@@ -0,0 +1,105 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BoidsCoreTypes.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Snapshot of a simulated flock, so that a world can start from a flock that already looks natural instead of warming one up.
+ * The file is memory mapped when the platform supports it, and the boids are read in place.
+ *
+ * Every value is a contiguous array, all values are little endian:
+ *   uint32 Magic ('BSNP'), uint32 Version, int32 NumBoids, int32 NumSpecies,
+ *   float LocationX[NumBoids], LocationY[NumBoids], LocationZ[NumBoids],
+ *   float VelocityX[NumBoids], VelocityY[NumBoids], VelocityZ[NumBoids],
+ *   float Speed[NumBoids], uint8 Species[NumBoids]
+ * Every array starts on a 16 byte boundary. Speed is the max speed of each boid, and species is an index the game maps to the
+ * entity types the boids are spawned from.
+ */
+class BOIDSCORE_API FBoidsSnapshot
+{
+public:
+
+	FBoidsSnapshot();
+	~FBoidsSnapshot();
+
+	/** Write a snapshot file, every array must have one value per boid. Returns false when the file could not be written */
+	static bool Save(const TCHAR* Filename, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, TConstArrayView<float> Speeds, TConstArrayView<uint8> Species);
+
+	/** Map a snapshot file, or read it when the platform can not map files. Returns false and leaves the snapshot empty when the file is not a valid snapshot */
+	bool Open(const TCHAR* Filename);
+
+	void Reset();
+
+	FORCEINLINE bool IsValid() const
+	{
+		return Data != nullptr;
+	}
+
+	FORCEINLINE int32 Num() const
+	{
+		return NumBoids;
+	}
+
+	/** Get the number of species, one more than the highest species of any boid */
+	FORCEINLINE int32 GetNumSpecies() const
+	{
+		return NumSpecies;
+	}
+
+	FORCEINLINE FVector GetLocation(const int32 Ndx) const
+	{
+		checkSlow(Ndx >= 0 && Ndx < NumBoids);
+		return FVector(LocationX[Ndx], LocationY[Ndx], LocationZ[Ndx]);
+	}
+
+	FORCEINLINE FVector GetVelocity(const int32 Ndx) const
+	{
+		checkSlow(Ndx >= 0 && Ndx < NumBoids);
+		return FVector(VelocityX[Ndx], VelocityY[Ndx], VelocityZ[Ndx]);
+	}
+
+	FORCEINLINE float GetSpeed(const int32 Ndx) const
+	{
+		checkSlow(Ndx >= 0 && Ndx < NumBoids);
+		return Speeds[Ndx];
+	}
+
+	FORCEINLINE uint8 GetSpecies(const int32 Ndx) const
+	{
+		checkSlow(Ndx >= 0 && Ndx < NumBoids);
+		return Species[Ndx];
+	}
+
+	/** Get the boids of each species, in snapshot order */
+	void GetSpeciesBoids(TArray<TArray<int32>>& OutSpeciesBoids) const;
+
+private:
+
+	/** Point the arrays into the data of a file, if it is a valid snapshot */
+	bool SetData(const uint8* InData, const int64 Size);
+
+	/** Mapped file and region, the region is released first */
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+
+	/** Content of the file, only used when the file could not be mapped */
+	TArray64<uint8> LoadedData;
+
+	const uint8* Data = nullptr;
+	int32 NumBoids = 0;
+	int32 NumSpecies = 0;
+
+	const float* LocationX = nullptr;
+	const float* LocationY = nullptr;
+	const float* LocationZ = nullptr;
+	const float* VelocityX = nullptr;
+	const float* VelocityY = nullptr;
+	const float* VelocityZ = nullptr;
+	const float* Speeds = nullptr;
+	const uint8* Species = nullptr;
+};
@@ -0,0 +1,25 @@
+// Copyright Dennis Andersson. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+[SupportedPlatforms(UnrealPlatformClass.Desktop)]
+public class BoidsCoreBenchmarkTarget : TargetRules
+{
+	public BoidsCoreBenchmarkTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Program;
+		LinkType = TargetLinkType.Monolithic;
+		LaunchModuleName = "BoidsCoreBenchmark";
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+
+		// Plain console program on top of Core, without the engine or UObjects
+		bBuildDeveloperTools = false;
+		bCompileAgainstEngine = false;
+		bCompileAgainstCoreUObject = false;
+		bCompileAgainstApplicationCore = false;
+		bCompileICU = false;
+		bIsBuildingConsoleApplication = true;
+		bUseLoggingInShipping = true;
+	}
+}
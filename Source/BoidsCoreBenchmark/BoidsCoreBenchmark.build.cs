@@ -0,0 +1,15 @@
+// Copyright Dennis Andersson. All Rights Reserved.
+
+using System.IO;
+using UnrealBuildTool;
+
+public class BoidsCoreBenchmark : ModuleRules
+{
+	public BoidsCoreBenchmark(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PublicIncludePaths.Add(Path.Combine(EngineDirectory, "Source/Runtime/Launch/Public"));
+		PrivateIncludePaths.Add(Path.Combine(EngineDirectory, "Source/Runtime/Launch/Private"));
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "Core", "Projects", "BoidsCore" });
+	}
+}
@@ -0,0 +1,687 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+/**
+ * Standalone benchmark of BoidsCore. Runs the grid, rules and movement of a seeded flock without the engine,
+ * and checks the results of the rule kernels against each other and against a brute force search.
+ * The rules are also checked with the flock split in two species, one of which only flocks with its own species,
+ * and with two species that only differ by their alignment weight, which have to steer differently.
+ * The render headings, and the packed headings of the compact render payload, are checked against their reference too.
+ * Obstacle avoidance runs on a synthetic distance field of a sphere, which is checked against the exact distance and saved and loaded again.
+ * The flock field is checked against a serial splat of the same boids, and a boid alone in it has to get no steering from itself.
+ *
+ * Build: Engine/Build/BatchFiles/Linux/Build.sh BoidsCoreBenchmark Linux Development -Project=<path>/MassBoidsGame.uproject
+ * Usage: BoidsCoreBenchmark [-Boids=50000] [-Frames=200] [-Warmup=20] [-Seed=0] [-Morton] [-NoIncremental] [-Checks=512]
+ */
+
+#include "BoidsDistanceField.h"
+#include "BoidsFlockField.h"
+#include "BoidsGrid.h"
+#include "BoidsMovement.h"
+#include "BoidsRender.h"
+#include "BoidsRules.h"
+
+#include "RequiredProgramMainCPPInclude.h"
+#include "Async/ParallelFor.h"
+#include "Math/RandomStream.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsCoreBenchmark, Log, All);
+
+IMPLEMENT_APPLICATION(BoidsCoreBenchmark, "BoidsCoreBenchmark");
+
+namespace
+{
+	/** Same defaults as UBoidsSettings and FBoidsSpeedFragment */
+	constexpr float Extent = 10000.f;
+	constexpr float TurnBackOffset = 500.f;
+	constexpr float TurnBackRate = 20.f;
+	constexpr float MaxSpeed = 300.f;
+
+	/** Same defaults as the obstacle settings of UBoidsSettings */
+	constexpr float ObstacleAvoidanceDistance = 500.f;
+	constexpr float ObstacleAvoidanceRate = 40.f;
+
+	/** Nodes of the flock field, and how many there are along each axis */
+	constexpr int32 FlockFieldNodesPerAxis = 16;
+
+	/** Same defaults as the flock field settings of UBoidsSettings */
+	constexpr float FlockCohesionRate = 5.f;
+	constexpr float FlockAlignment = 0.1f / 10.f;
+
+	/** Time spent in a single step, one sample per measured frame */
+	struct FBenchmarkStep
+	{
+		const TCHAR* Name;
+		TArray<double> Samples;
+
+		void Report()
+		{
+			if (Samples.Num() == 0)
+			{
+				return;
+			}
+
+			Samples.Sort();
+
+			double Sum = 0.0;
+			for (const double Sample : Samples)
+			{
+				Sum += Sample;
+			}
+
+			const double Mean = Sum / Samples.Num() * 1000.0;
+			const double P50 = Samples[FMath::Min((int32)(Samples.Num() * 0.50), Samples.Num() - 1)] * 1000.0;
+			const double P99 = Samples[FMath::Min((int32)(Samples.Num() * 0.99), Samples.Num() - 1)] * 1000.0;
+
+			UE_LOG(LogBoidsCoreBenchmark, Display, TEXT("%-18s mean %8.3f ms  p50 %8.3f ms  p99 %8.3f ms"), Name, Mean, P50, P99);
+		}
+	};
+
+	/** Get the steering of a single boid by testing every other boid. Species is the species of every boid in boid order, if there are several */
+	FVector GetBruteForceSteering(const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsRuleSettings& Settings, const int32 BoidNdx, const FBoidsFloatBuffer* Species = nullptr)
+	{
+		BoidsCore::FBoidsRuleDistances Distances;
+		Distances.Alignment = Settings.AlignmentDistanceSquared;
+		Distances.Separation = Settings.SeparationDistanceSquared;
+		Distances.Cohesion = Settings.CohesionDistanceSquared;
+
+		const FVector3f BoidLocation(Locations.Get(BoidNdx));
+		const FVector3f BoidVelocity(Velocities.Get(BoidNdx));
+
+		BoidsCore::FBoidsRuleSums Sums;
+		if (Species && !Settings.bFlockWithOtherSpecies)
+		{
+			BoidsCore::FBoidsSpeciesFilter SpeciesFilter;
+			SpeciesFilter.Species = Species->GetData();
+			SpeciesFilter.BoidSpecies = (*Species)[BoidNdx];
+
+			BoidsCore::AccumulateBoidRules<EBoidsRuleMask::All, true>(Locations, Velocities, BoidLocation, Distances, 0, Locations.Num(), Sums, SpeciesFilter);
+		}
+		else
+		{
+			BoidsCore::AccumulateBoidRules(Locations, Velocities, BoidLocation, Distances, 0, Locations.Num(), Sums);
+		}
+
+		if (Distances.Cohesion > 0.f)
+		{
+			Sums.Cohesion -= BoidVelocity;
+			Sums.NumCohesion -= 1.f;
+		}
+
+		FVector3f Steering = Sums.Separation * Settings.Separation;
+
+		if (Sums.NumAlignment > 0.f)
+		{
+			Steering += (Sums.Alignment / Sums.NumAlignment - BoidLocation) * Settings.Alignment;
+		}
+
+		if (Sums.NumCohesion > 0.f)
+		{
+			Steering += (Sums.Cohesion / Sums.NumCohesion - BoidVelocity) * Settings.Cohesion;
+		}
+
+		return FVector(Steering);
+	}
+
+	/** Relative tolerance for steerings summed in a different order */
+	bool IsSteeringNearlyEqual(const FVector& A, const FVector& B)
+	{
+		return (A - B).Size() <= 1.e-3f * FMath::Max3(A.Size(), B.Size(), 1.f);
+	}
+
+	/**
+	 * Check two species that only differ by their alignment weight. Every boid has to get the steering of its own species, and boids with
+	 * neighbors have to steer differently than they would with the weight of the other species. Returns the number of mismatches
+	 */
+	int32 CheckSpeciesAlignment(const FBoidsGrid& Grid, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsRuleSettings& Settings,
+		const FBoidsFloatBuffer& BoidsSpecies, const FBoidsFloatBuffer& SortedSpecies, TArray<FVector>& OutSteerings, const int32 Stride)
+	{
+		FBoidsRuleSettings SpeciesRuleSettings[2] = { Settings, Settings };
+		SpeciesRuleSettings[0].Alignment = 0.1f / 10.f;
+		SpeciesRuleSettings[1].Alignment = 1.f / 10.f;
+
+		BoidsCore::RunBoidsRules(Grid, SpeciesRuleSettings, SortedSpecies, OutSteerings, TConstArrayView<int32>());
+
+		int32 NumMismatches = 0;
+		int32 NumDiffering = 0;
+
+		for (int32 Ndx = 0; Ndx < Locations.Num(); Ndx += Stride)
+		{
+			const int32 Species = (int32)BoidsSpecies[Ndx];
+			const FVector Expected = GetBruteForceSteering(Locations, Velocities, SpeciesRuleSettings[Species], Ndx, &BoidsSpecies);
+			const FVector OtherSpecies = GetBruteForceSteering(Locations, Velocities, SpeciesRuleSettings[1 - Species], Ndx, &BoidsSpecies);
+
+			if (!IsSteeringNearlyEqual(Expected, OutSteerings[Ndx]))
+			{
+				UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Boid %d with alignment of species %d: expected %s, got %s"), Ndx, Species, *Expected.ToString(), *OutSteerings[Ndx].ToString());
+				++NumMismatches;
+			}
+
+			NumDiffering += !IsSteeringNearlyEqual(Expected, OtherSpecies);
+		}
+
+		// The flock is dense enough that most boids have neighbors to align with
+		if (NumDiffering == 0)
+		{
+			UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Species with different alignment weights steer the same"));
+			++NumMismatches;
+		}
+
+		return NumMismatches;
+	}
+
+	/**
+	 * Check the distance field of a sphere against the exact distance at random locations, and against itself after saving and loading it.
+	 * Returns the number of mismatches
+	 */
+	int32 CheckDistanceField(const FBoidsDistanceField& Field, const FVector& SphereCenter, const float SphereRadius, FRandomStream& RandomStream, const int32 NumChecks)
+	{
+		int32 NumMismatches = 0;
+
+		const FBox Bounds = Field.GetBounds();
+		const FVector SampleSpacing = Bounds.GetSize() / FVector(Field.GetResolution() - FIntVector(1));
+		const float MaxSampleSpacing = SampleSpacing.GetMax();
+
+		for (int32 CheckNdx = 0; CheckNdx < NumChecks; CheckNdx++)
+		{
+			const FVector Location = FVector(RandomStream.FRandRange(Bounds.Min.X, Bounds.Max.X), RandomStream.FRandRange(Bounds.Min.Y, Bounds.Max.Y), RandomStream.FRandRange(Bounds.Min.Z, Bounds.Max.Z));
+			const FVector FromCenter = Location - SphereCenter;
+			const float ExpectedDistance = FromCenter.Size() - SphereRadius;
+
+			FVector Gradient;
+			const float Distance = Field.GetDistanceAndGradient(Location, Gradient);
+
+			// Interpolation is off by less than the distance between samples, and the gradient has to point away from the sphere
+			// except close to its center, where the distance is not smooth
+			const bool bDistanceMatches = FMath::Abs(Distance - ExpectedDistance) <= MaxSampleSpacing;
+			const bool bGradientMatches = FromCenter.Size() < MaxSampleSpacing * 2.f || (Gradient.GetSafeNormal() | FromCenter.GetSafeNormal()) >= 0.9f;
+
+			if (!bDistanceMatches || !bGradientMatches)
+			{
+				UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Distance field at %s: distance %f gradient %s, expected %f"), *Location.ToString(), Distance, *Gradient.ToString(), ExpectedDistance);
+				++NumMismatches;
+			}
+		}
+
+		TArray<uint8> FieldData;
+		Field.Save(FieldData);
+
+		FBoidsDistanceField LoadedField;
+		if (!LoadedField.Load(FieldData) || LoadedField.GetResolution() != Field.GetResolution() || !(LoadedField.GetBounds() == Bounds))
+		{
+			UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Distance field could not be saved and loaded again"));
+			return NumMismatches + 1;
+		}
+
+		// Distances are quantized to 16 bits of the largest distance
+		float MaxDistance = 0.f;
+		for (const float Distance : Field.GetDistances())
+		{
+			MaxDistance = FMath::Max(MaxDistance, FMath::Abs(Distance));
+		}
+
+		const float Tolerance = MaxDistance / 32767.f + KINDA_SMALL_NUMBER;
+		for (int32 Ndx = 0; Ndx < Field.GetDistances().Num(); Ndx++)
+		{
+			if (FMath::Abs(Field.GetDistances()[Ndx] - LoadedField.GetDistances()[Ndx]) > Tolerance)
+			{
+				UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Loaded distance field sample %d: %f, expected %f"), Ndx, LoadedField.GetDistances()[Ndx], Field.GetDistances()[Ndx]);
+				++NumMismatches;
+			}
+		}
+
+		UE_LOG(LogBoidsCoreBenchmark, Display, TEXT("Distance field of %s samples saved in %d bytes"), *Field.GetResolution().ToString(), FieldData.Num());
+
+		return NumMismatches;
+	}
+
+	/** Get the eight nodes around a location and their trilinear weights, the way the flock field splats and samples them */
+	void GetFlockNodeWeights(const FVector& Location, const FBoidsFlockFieldSettings& Settings, int32 OutNodes[8], float OutWeights[8])
+	{
+		const int32 NodesPerAxis = Settings.NodesPerAxis;
+		const FVector NodeSpacing = FVector(Settings.HalfSize * 2.f / (NodesPerAxis - 1));
+		const FVector NodeCoords = (Location - FVector(Settings.Origin - FVector3f(Settings.HalfSize))) / NodeSpacing;
+
+		int32 Node[3];
+		float Frac[3];
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			const float Coord = FMath::Clamp((float)NodeCoords[Axis], 0.f, (float)(NodesPerAxis - 1));
+			Node[Axis] = FMath::Min(FMath::FloorToInt(Coord), NodesPerAxis - 2);
+			Frac[Axis] = Coord - Node[Axis];
+		}
+
+		for (int32 CornerNdx = 0; CornerNdx < 8; CornerNdx++)
+		{
+			const int32 Offset[3] = { CornerNdx & 1, (CornerNdx >> 1) & 1, (CornerNdx >> 2) & 1 };
+
+			OutNodes[CornerNdx] = (Node[0] + Offset[0]) + ((Node[1] + Offset[1]) + (Node[2] + Offset[2]) * NodesPerAxis) * NodesPerAxis;
+			OutWeights[CornerNdx] = 1.f;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				OutWeights[CornerNdx] *= Offset[Axis] ? Frac[Axis] : 1.f - Frac[Axis];
+			}
+		}
+	}
+
+	/**
+	 * Check the flock field against a serial splat of the same boids at random locations, and check that a boid alone in a field is not
+	 * steered by itself. Returns the number of mismatches
+	 */
+	int32 CheckFlockField(const FBoidsFlockField& Field, const FBoidsVectorSoA& Locations, const FBoidsVectorSoA& Velocities, const FBoidsFlockFieldSettings& Settings, FRandomStream& RandomStream, const int32 NumChecks)
+	{
+		int32 NumMismatches = 0;
+
+		const int32 NumNodes = Settings.NodesPerAxis * Settings.NodesPerAxis * Settings.NodesPerAxis;
+
+		TArray<float> Densities;
+		TArray<FVector> NodeVelocities;
+		Densities.SetNumZeroed(NumNodes);
+		NodeVelocities.SetNumZeroed(NumNodes);
+
+		for (int32 Ndx = 0; Ndx < Locations.Num(); Ndx++)
+		{
+			int32 Nodes[8];
+			float Weights[8];
+			GetFlockNodeWeights(Locations.Get(Ndx), Settings, Nodes, Weights);
+
+			for (int32 CornerNdx = 0; CornerNdx < 8; CornerNdx++)
+			{
+				Densities[Nodes[CornerNdx]] += Weights[CornerNdx];
+				NodeVelocities[Nodes[CornerNdx]] += Velocities.Get(Ndx) * Weights[CornerNdx];
+			}
+		}
+
+		for (int32 CheckNdx = 0; CheckNdx < NumChecks; CheckNdx++)
+		{
+			const FVector Location = FVector(Settings.Origin) + FVector(RandomStream.FRandRange(-1.f, 1.f), RandomStream.FRandRange(-1.f, 1.f), RandomStream.FRandRange(-1.f, 1.f)) * Settings.HalfSize;
+
+			int32 Nodes[8];
+			float Weights[8];
+			GetFlockNodeWeights(Location, Settings, Nodes, Weights);
+
+			float ExpectedDensity = 0.f;
+			FVector ExpectedVelocity = FVector::ZeroVector;
+			for (int32 CornerNdx = 0; CornerNdx < 8; CornerNdx++)
+			{
+				ExpectedDensity += Densities[Nodes[CornerNdx]] * Weights[CornerNdx];
+				ExpectedVelocity += NodeVelocities[Nodes[CornerNdx]] * Weights[CornerNdx];
+			}
+
+			// The blocks are summed in a different order than the serial splat
+			const FBoidsFlockSample Sample = Field.Sample(FVector3f(Location));
+			if (FMath::Abs(Sample.Density - ExpectedDensity) > 1.e-3f * FMath::Max(ExpectedDensity, 1.f) || !IsSteeringNearlyEqual(FVector(Sample.Velocity), ExpectedVelocity))
+			{
+				UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Flock field at %s: density %f velocity %s, expected %f %s"),
+					*Location.ToString(), Sample.Density, *Sample.Velocity.ToString(), ExpectedDensity, *ExpectedVelocity.ToString());
+				++NumMismatches;
+			}
+		}
+
+		// A boid leaves itself out of the field it samples, so alone it sees nothing anywhere in its cell
+		FBoidsVectorSoA LoneLocation;
+		FBoidsVectorSoA LoneVelocity;
+		LoneLocation.SetNumUninitialized(1);
+		LoneVelocity.SetNumUninitialized(1);
+
+		FBoidsFlockField LoneField;
+		for (int32 CheckNdx = 0; CheckNdx < 16; CheckNdx++)
+		{
+			const FVector Location = FVector(Settings.Origin) + FVector(RandomStream.FRandRange(-1.f, 1.f), RandomStream.FRandRange(-1.f, 1.f), RandomStream.FRandRange(-1.f, 1.f)) * Settings.HalfSize;
+			const FVector Velocity = RandomStream.GetUnitVector() * MaxSpeed;
+
+			LoneLocation.Set(0, Location);
+			LoneVelocity.Set(0, Velocity);
+			LoneField.Build(LoneLocation, LoneVelocity, Settings);
+
+			const FBoidsFlockSample Sample = LoneField.SampleOthers(FVector3f(Location), FVector3f(Velocity));
+			if (FMath::Abs(Sample.Density) > 1.e-4f || Sample.DensityGradient.Size() * Settings.HalfSize > 1.e-3f || Sample.Velocity.Size() > 1.e-2f)
+			{
+				UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Lone boid at %s sees density %f gradient %s velocity %s"),
+					*Location.ToString(), Sample.Density, *Sample.DensityGradient.ToString(), *Sample.Velocity.ToString());
+				++NumMismatches;
+			}
+		}
+
+		return NumMismatches;
+	}
+
+	int32 RunBenchmark()
+	{
+		int32 NumBoids = 50000;
+		int32 NumFrames = 200;
+		int32 NumWarmupFrames = 20;
+		int32 Seed = 0;
+		int32 NumChecks = 512;
+
+		const TCHAR* CommandLine = FCommandLine::Get();
+		FParse::Value(CommandLine, TEXT("Boids="), NumBoids);
+		FParse::Value(CommandLine, TEXT("Frames="), NumFrames);
+		FParse::Value(CommandLine, TEXT("Warmup="), NumWarmupFrames);
+		FParse::Value(CommandLine, TEXT("Seed="), Seed);
+		FParse::Value(CommandLine, TEXT("Checks="), NumChecks);
+
+		if (NumBoids <= 0 || NumFrames <= 0 || NumWarmupFrames < 0)
+		{
+			UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Invalid benchmark parameters"));
+			return 1;
+		}
+
+		const float HalfSize = Extent / 2.f + TurnBackOffset;
+		const FBox Bounds = FBox(FVector(-Extent / 2.f - TurnBackOffset), FVector(Extent / 2.f + TurnBackOffset));
+		const float DeltaTime = 1.f / 60.f;
+
+		// Same weights as the rule processor gets from the default rules of FBoidsRulesFragment
+		FBoidsRuleSettings RuleSettings;
+		RuleSettings.Alignment = 0.5f / 10.f;
+		RuleSettings.Separation = 1.f / 10.f;
+		RuleSettings.Cohesion = 0.5f / 10.f;
+		RuleSettings.AlignmentDistanceSquared = 500.f * 500.f;
+		RuleSettings.SeparationDistanceSquared = 100.f * 100.f;
+		RuleSettings.CohesionDistanceSquared = 500.f * 500.f;
+
+		// Only separation, which runs the kernel specialized for it
+		FBoidsRuleSettings SeparationRuleSettings = RuleSettings;
+		SeparationRuleSettings.Alignment = 0.f;
+		SeparationRuleSettings.Cohesion = 0.f;
+
+		// Second species with shorter distances that ignores the first one except for separation, every other boid belongs to it
+		FBoidsRuleSettings SpeciesRuleSettings[2] = { RuleSettings, RuleSettings };
+		SpeciesRuleSettings[1].Alignment = 0.5f / 10.f;
+		SpeciesRuleSettings[1].Cohesion = 1.f / 10.f;
+		SpeciesRuleSettings[1].AlignmentDistanceSquared = 300.f * 300.f;
+		SpeciesRuleSettings[1].SeparationDistanceSquared = 150.f * 150.f;
+		SpeciesRuleSettings[1].CohesionDistanceSquared = 400.f * 400.f;
+		SpeciesRuleSettings[1].bFlockWithOtherSpecies = false;
+
+		TArray<uint8> BoidsSpecies;
+		FBoidsFloatBuffer BoidsSpeciesFloat;
+		FBoidsFloatBuffer SortedSpecies;
+		BoidsSpecies.SetNumUninitialized(NumBoids);
+		BoidsSpeciesFloat.SetNumUninitialized(NumBoids);
+		SortedSpecies.SetNumUninitialized(NumBoids);
+		for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+		{
+			BoidsSpecies[Ndx] = Ndx % 2;
+			BoidsSpeciesFloat[Ndx] = Ndx % 2;
+		}
+
+		FBoidsGridSettings GridSettings;
+		GridSettings.HalfSize = HalfSize;
+		GridSettings.MaxDistance = 500.f;
+		GridSettings.bMortonOrder = FParse::Param(CommandLine, TEXT("Morton"));
+		GridSettings.bIncremental = !FParse::Param(CommandLine, TEXT("NoIncremental"));
+
+		// Seeded flock, spawned like the spawn data generator does
+		FRandomStream RandomStream(Seed);
+
+		FBoidsVectorSoA Locations;
+		FBoidsVectorSoA Velocities;
+		Locations.SetNumUninitialized(NumBoids);
+		Velocities.SetNumUninitialized(NumBoids);
+
+		for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+		{
+			Locations.Set(Ndx, FVector(RandomStream.FRandRange(-HalfSize, HalfSize), RandomStream.FRandRange(-HalfSize, HalfSize), RandomStream.FRandRange(-HalfSize, HalfSize)));
+			Velocities.Set(Ndx, RandomStream.GetUnitVector() * MaxSpeed);
+		}
+
+		// Synthetic obstacle in the middle of the bounds
+		const FVector SphereCenter = FVector::ZeroVector;
+		const float SphereRadius = Extent / 4.f;
+
+		FBoidsDistanceField ObstacleField;
+		ObstacleField.Build(Bounds, FIntVector(32), [&SphereCenter, SphereRadius] (const FVector& Location)
+		{
+			return (float)FVector::Dist(Location, SphereCenter) - SphereRadius;
+		});
+
+		TArray<FVector> Avoidances;
+		Avoidances.SetNumZeroed(NumBoids);
+
+		FBoidsFlockFieldSettings FlockFieldSettings;
+		FlockFieldSettings.HalfSize = HalfSize;
+		FlockFieldSettings.NodesPerAxis = FlockFieldNodesPerAxis;
+
+		FBoidsFlockRuleSettings FlockRuleSettings;
+		FlockRuleSettings.Cohesion = FlockCohesionRate;
+		FlockRuleSettings.Alignment = FlockAlignment;
+
+		FBoidsFlockField FlockField;
+		TArray<FVector> FlockSteerings;
+		FlockSteerings.SetNumZeroed(NumBoids);
+
+		FBoidsGrid Grid;
+		TArray<FVector> Steerings;
+		TArray<FVector> ScalarSteerings;
+		Steerings.SetNumZeroed(NumBoids);
+		ScalarSteerings.SetNumZeroed(NumBoids);
+
+		TArray<FQuat> Headings;
+		TArray<FQuat> RotatorHeadings;
+		Headings.SetNumUninitialized(NumBoids);
+		RotatorHeadings.SetNumUninitialized(NumBoids);
+
+		TArray<float> PackedHeadings;
+		PackedHeadings.SetNumUninitialized(NumBoids);
+
+		FBenchmarkStep SetupGrid { TEXT("SetupGrid") };
+		FBenchmarkStep RulesScalar { TEXT("RulesScalar") };
+		FBenchmarkStep RulesVectorized { TEXT("RulesVectorized") };
+		FBenchmarkStep RulesSeparation { TEXT("RulesSeparation") };
+		FBenchmarkStep Move { TEXT("Move") };
+		FBenchmarkStep HeadingRotator { TEXT("HeadingRotator") };
+		FBenchmarkStep Heading { TEXT("Heading") };
+		FBenchmarkStep PackedHeading { TEXT("PackedHeading") };
+		FBenchmarkStep ObstacleAvoidance { TEXT("ObstacleAvoidance") };
+		FBenchmarkStep BuildFlockField { TEXT("BuildFlockField") };
+		FBenchmarkStep FlockSteering { TEXT("FlockSteering") };
+
+		UE_LOG(LogBoidsCoreBenchmark, Display, TEXT("Running %d boids for %d frames (%d warmup frames, seed %d)"), NumBoids, NumFrames, NumWarmupFrames, Seed);
+
+		int32 NumMismatches = CheckDistanceField(ObstacleField, SphereCenter, SphereRadius, RandomStream, NumChecks);
+
+		for (int32 FrameNdx = 0; FrameNdx < NumWarmupFrames + NumFrames; FrameNdx++)
+		{
+			const bool bMeasured = FrameNdx >= NumWarmupFrames;
+
+			double StartTime = FPlatformTime::Seconds();
+			Grid.Setup(Locations, Velocities, GridSettings, false);
+			const double GridTime = FPlatformTime::Seconds() - StartTime;
+
+			RuleSettings.bVectorized = false;
+			StartTime = FPlatformTime::Seconds();
+			BoidsCore::RunBoidsRules(Grid, RuleSettings, ScalarSteerings);
+			const double ScalarTime = FPlatformTime::Seconds() - StartTime;
+
+			RuleSettings.bVectorized = true;
+			StartTime = FPlatformTime::Seconds();
+			BoidsCore::RunBoidsRules(Grid, RuleSettings, Steerings);
+			const double VectorizedTime = FPlatformTime::Seconds() - StartTime;
+
+			// Written over the scalar steerings, which are only used for checking
+			StartTime = FPlatformTime::Seconds();
+			BoidsCore::RunBoidsRules(Grid, SeparationRuleSettings, ScalarSteerings);
+			const double SeparationTime = FPlatformTime::Seconds() - StartTime;
+
+			// Both kernels and the grid must find the same neighbors as a search over every boid
+			if (FrameNdx == 0 || FrameNdx + 1 == NumWarmupFrames + NumFrames)
+			{
+				const int32 Stride = FMath::Max(1, NumBoids / FMath::Max(NumChecks, 1));
+				for (int32 Ndx = 0; Ndx < NumBoids; Ndx += Stride)
+				{
+					const FVector Expected = GetBruteForceSteering(Locations, Velocities, SeparationRuleSettings, Ndx);
+					if (!IsSteeringNearlyEqual(Expected, ScalarSteerings[Ndx]))
+					{
+						UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Frame %d boid %d: expected %s, separation only %s"),
+							FrameNdx, Ndx, *Expected.ToString(), *ScalarSteerings[Ndx].ToString());
+						++NumMismatches;
+					}
+				}
+
+				RuleSettings.bVectorized = false;
+				BoidsCore::RunBoidsRules(Grid, RuleSettings, ScalarSteerings);
+				RuleSettings.bVectorized = true;
+
+				for (int32 Ndx = 0; Ndx < NumBoids; Ndx += Stride)
+				{
+					const FVector Expected = GetBruteForceSteering(Locations, Velocities, RuleSettings, Ndx);
+					if (!IsSteeringNearlyEqual(Expected, Steerings[Ndx]) || !IsSteeringNearlyEqual(Expected, ScalarSteerings[Ndx]))
+					{
+						UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Frame %d boid %d: expected %s, vectorized %s, scalar %s"),
+							FrameNdx, Ndx, *Expected.ToString(), *Steerings[Ndx].ToString(), *ScalarSteerings[Ndx].ToString());
+						++NumMismatches;
+					}
+				}
+
+				// Same check with two species on both kernels, written over the scalar steerings which are only used for checking
+				BoidsCore::SortBoidsSpecies(Grid, BoidsSpecies, SortedSpecies);
+
+				for (const bool bVectorized : { false, true })
+				{
+					SpeciesRuleSettings[0].bVectorized = bVectorized;
+					SpeciesRuleSettings[1].bVectorized = bVectorized;
+					BoidsCore::RunBoidsRules(Grid, SpeciesRuleSettings, SortedSpecies, ScalarSteerings, TConstArrayView<int32>());
+
+					for (int32 Ndx = 0; Ndx < NumBoids; Ndx += Stride)
+					{
+						const FVector Expected = GetBruteForceSteering(Locations, Velocities, SpeciesRuleSettings[BoidsSpecies[Ndx]], Ndx, &BoidsSpeciesFloat);
+						if (!IsSteeringNearlyEqual(Expected, ScalarSteerings[Ndx]))
+						{
+							UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Frame %d boid %d of species %d: expected %s, %s %s"),
+								FrameNdx, Ndx, BoidsSpecies[Ndx], *Expected.ToString(), bVectorized ? TEXT("vectorized") : TEXT("scalar"), *ScalarSteerings[Ndx].ToString());
+							++NumMismatches;
+						}
+					}
+				}
+
+				NumMismatches += CheckSpeciesAlignment(Grid, Locations, Velocities, RuleSettings, BoidsSpeciesFloat, SortedSpecies, ScalarSteerings, Stride);
+			}
+
+			// Long range steering, kept apart from the steering that moves the flock so the other steps measure the same flock as before
+			StartTime = FPlatformTime::Seconds();
+			FlockField.Build(Locations, Velocities, FlockFieldSettings);
+			const double BuildFlockFieldTime = FPlatformTime::Seconds() - StartTime;
+
+			StartTime = FPlatformTime::Seconds();
+			BoidsCore::AddFlockSteering(FlockField, Locations, Velocities, FlockRuleSettings, FlockSteerings);
+			const double FlockSteeringTime = FPlatformTime::Seconds() - StartTime;
+
+			if (FrameNdx == 0)
+			{
+				NumMismatches += CheckFlockField(FlockField, Locations, Velocities, FlockFieldSettings, RandomStream, FMath::Max(NumChecks / 8, 1));
+			}
+
+			StartTime = FPlatformTime::Seconds();
+			ParallelFor(NumBoids, [&] (int32 Ndx)
+			{
+				FVector Location = Locations.Get(Ndx);
+				FVector Velocity = Velocities.Get(Ndx);
+
+				BoidsCore::MoveBoid(Location, Velocity, Steerings[Ndx] + BoidsCore::GetTurnBack(Location, Bounds, TurnBackRate), MaxSpeed, DeltaTime);
+
+				Locations.Set(Ndx, Location);
+				Velocities.Set(Ndx, Velocity);
+			});
+			const double MoveTime = FPlatformTime::Seconds() - StartTime;
+
+			// Rotation of the render instances, the way it used to be built and without trigonometric functions
+			StartTime = FPlatformTime::Seconds();
+			ParallelFor(NumBoids, [&] (int32 Ndx)
+			{
+				RotatorHeadings[Ndx] = (Velocities.Get(Ndx).Rotation() - FRotator(90.f, 0.f, 0.f)).Quaternion();
+			});
+			const double HeadingRotatorTime = FPlatformTime::Seconds() - StartTime;
+
+			StartTime = FPlatformTime::Seconds();
+			ParallelFor(NumBoids, [&] (int32 Ndx)
+			{
+				Headings[Ndx] = BoidsCore::GetHeadingRotation(Velocities.Get(Ndx));
+			});
+			const double HeadingTime = FPlatformTime::Seconds() - StartTime;
+
+			StartTime = FPlatformTime::Seconds();
+			ParallelFor(NumBoids, [&] (int32 Ndx)
+			{
+				PackedHeadings[Ndx] = BoidsCore::PackHeading(Velocities.Get(Ndx));
+			});
+			const double PackedHeadingTime = FPlatformTime::Seconds() - StartTime;
+
+			StartTime = FPlatformTime::Seconds();
+			ParallelFor(NumBoids, [&] (int32 Ndx)
+			{
+				Avoidances[Ndx] = BoidsCore::GetObstacleAvoidance(ObstacleField, Locations.Get(Ndx), ObstacleAvoidanceDistance, ObstacleAvoidanceRate);
+			});
+			const double ObstacleAvoidanceTime = FPlatformTime::Seconds() - StartTime;
+
+			if (FrameNdx + 1 == NumWarmupFrames + NumFrames)
+			{
+				for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+				{
+					// Both quaternions of a rotation are fine
+					if (FMath::Abs(Headings[Ndx] | RotatorHeadings[Ndx]) < 1.f - 1.e-4f)
+					{
+						UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Boid %d: heading %s, expected %s"), Ndx, *Headings[Ndx].ToString(), *RotatorHeadings[Ndx].ToString());
+						++NumMismatches;
+					}
+
+					// The packed heading has 12 bits per octahedron axis, which is within a tenth of a degree
+					const FVector Direction = Velocities.Get(Ndx).GetSafeNormal(SMALL_NUMBER, FVector::ForwardVector);
+					const FVector UnpackedDirection = BoidsCore::UnpackHeading(PackedHeadings[Ndx]);
+					if ((Direction | UnpackedDirection) < 1.f - 1.e-5f)
+					{
+						UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("Boid %d: packed heading %s, expected %s"), Ndx, *UnpackedDirection.ToString(), *Direction.ToString());
+						++NumMismatches;
+					}
+				}
+			}
+
+			if (bMeasured)
+			{
+				SetupGrid.Samples.Add(GridTime);
+				RulesScalar.Samples.Add(ScalarTime);
+				RulesVectorized.Samples.Add(VectorizedTime);
+				RulesSeparation.Samples.Add(SeparationTime);
+				Move.Samples.Add(MoveTime);
+				HeadingRotator.Samples.Add(HeadingRotatorTime);
+				Heading.Samples.Add(HeadingTime);
+				PackedHeading.Samples.Add(PackedHeadingTime);
+				ObstacleAvoidance.Samples.Add(ObstacleAvoidanceTime);
+				BuildFlockField.Samples.Add(BuildFlockFieldTime);
+				FlockSteering.Samples.Add(FlockSteeringTime);
+			}
+		}
+
+		SetupGrid.Report();
+		RulesScalar.Report();
+		RulesVectorized.Report();
+		RulesSeparation.Report();
+		Move.Report();
+		HeadingRotator.Report();
+		Heading.Report();
+		PackedHeading.Report();
+		ObstacleAvoidance.Report();
+		BuildFlockField.Report();
+		FlockSteering.Report();
+
+		if (NumMismatches > 0)
+		{
+			UE_LOG(LogBoidsCoreBenchmark, Error, TEXT("%d results did not match their reference"), NumMismatches);
+			return 1;
+		}
+
+		return 0;
+	}
+}
+
+INT32_MAIN_INT32_ARGC_TCHAR_ARGV()
+{
+	GEngineLoop.PreInit(ArgC, ArgV);
+
+	const int32 Result = RunBenchmark();
+
+	FEngineLoop::AppPreExit();
+	FModuleManager::Get().UnloadModulesAtShutdown();
+	FEngineLoop::AppExit();
+
+	return Result;
+}
@@ -2,13 +2,27 @@
 
 
 #include "BoidsRenderActor.h"
+#include "Components/BoidsTileMeshComponent.h"
 
 // Engine
-#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
 #include "MassAgentComponent.h"
 
+namespace
+{
+	/** Fraction of a tile a boid can go past its bounds before it moves to the next tile, so boids on the edge do not switch back and forth */
+	constexpr float TileMargin = 0.1f;
+
+	/** Time since a tile was last rendered before it is considered hidden */
+	constexpr float TileRenderedTolerance = 0.2f;
+}
+
 ABoidsRenderActor::ABoidsRenderActor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
+	, TilesOrigin(FVector::ZeroVector)
+	, TileSize(FVector(WORLD_MAX))
+	, TilesPerAxis(1)
+	, bHasPendingInstances(false)
 {
 	PrimaryActorTick.bCanEverTick = false;
 
@@ -16,26 +30,233 @@ ABoidsRenderActor::ABoidsRenderActor(const FObjectInitializer& ObjectInitializer
 	SetRootComponent(SceneRootComponent);
 }
 
-void ABoidsRenderActor::CreateNewRenderComponent(const FBoidsMeshFragment* MeshFragment)
+void ABoidsRenderActor::SetupTiles(const FBox& Bounds, const int32 InTilesPerAxis)
+{
+	// Instances keep their tile, so the tiles can not change once there are any
+	if (RenderMeshes.Num() > 0 || !Bounds.IsValid)
+	{
+		return;
+	}
+
+	TilesPerAxis = FMath::Max(InTilesPerAxis, 1);
+	TilesOrigin = Bounds.Min;
+	TileSize = Bounds.GetSize() / TilesPerAxis;
+}
+
+int32 ABoidsRenderActor::GetOrCreateRenderMesh(const FBoidsMeshFragment* MeshFragment, const int32 TileIndex)
+{
+	if (!MeshFragment)
+	{
+		return INDEX_NONE;
+	}
+
+	const TPair<const FBoidsMeshFragment*, int32> MeshKey(MeshFragment, TileIndex);
+	if (const int32* MeshIndex = RenderMeshIndices.Find(MeshKey))
+	{
+		return *MeshIndex;
+	}
+
+	UBoidsTileMeshComponent* Component = NewObject<UBoidsTileMeshComponent>(this);
+	Component->SetStaticMesh(MeshFragment->BoidMesh);
+	Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Component->SetupAttachment(GetRootComponent());
+	Component->RegisterComponent();
+
+	const int32 TileX = TileIndex % TilesPerAxis;
+	const int32 TileY = (TileIndex / TilesPerAxis) % TilesPerAxis;
+	const int32 TileZ = TileIndex / (TilesPerAxis * TilesPerAxis);
+	const FVector TileMin = TilesOrigin + FVector(TileX, TileY, TileZ) * TileSize;
+
+	const int32 MeshIndex = RenderMeshes.AddDefaulted();
+	FBoidsRenderMesh& RenderMesh = RenderMeshes[MeshIndex];
+	RenderMesh.Component = Component;
+	RenderMesh.MeshFragment = MeshFragment;
+	RenderMesh.TileIndex = TileIndex;
+	RenderMesh.TileBounds = FBox(TileMin, TileMin + TileSize).ExpandBy(TileSize * TileMargin);
+	RenderMeshIndices.Emplace(MeshKey, MeshIndex);
+
+	Component->SetTileBounds(RenderMesh.TileBounds);
+	UpdateTileInstanceTransform(RenderMesh);
+
+	return MeshIndex;
+}
+
+int32 ABoidsRenderActor::AddInstance(const int32 MeshIndex, const FMassEntityHandle Entity, uint32& NumAllocations)
+{
+	FBoidsRenderMesh& RenderMesh = RenderMeshes[MeshIndex];
+
+	NumAllocations += RenderMesh.InstanceEntities.Num() == RenderMesh.InstanceEntities.Max();
+	NumAllocations += RenderMesh.InstanceXForms.Num() == RenderMesh.InstanceXForms.Max();
+	NumAllocations += RenderMesh.InstanceCustomData.Num() == RenderMesh.InstanceCustomData.Max();
+
+	RenderMesh.InstanceXForms.Add(FTransform::Identity);
+	RenderMesh.InstanceCustomData.AddZeroed(FBoidsRenderMesh::NumCompactCustomDataFloats);
+	return RenderMesh.InstanceEntities.Add(Entity);
+}
+
+FMassEntityHandle ABoidsRenderActor::RemoveInstance(const int32 MeshIndex, const int32 InstanceIndex)
+{
+	FBoidsRenderMesh& RenderMesh = RenderMeshes[MeshIndex];
+	check(RenderMesh.InstanceEntities.IsValidIndex(InstanceIndex));
+
+	// Instances added this frame are not in the component yet
+	const int32 NumComponentInstances = RenderMesh.Component->GetInstanceCount();
+	const int32 LastIndex = RenderMesh.InstanceEntities.Num() - 1;
+
+	FMassEntityHandle MovedEntity;
+	if (InstanceIndex != LastIndex)
+	{
+		MovedEntity = RenderMesh.InstanceEntities[LastIndex];
+		RenderMesh.InstanceEntities[InstanceIndex] = MovedEntity;
+		RenderMesh.InstanceXForms[InstanceIndex] = RenderMesh.InstanceXForms[LastIndex];
+
+		const int32 NumCustomDataFloats = FBoidsRenderMesh::NumCompactCustomDataFloats;
+		FMemory::Memcpy(&RenderMesh.InstanceCustomData[InstanceIndex * NumCustomDataFloats], &RenderMesh.InstanceCustomData[LastIndex * NumCustomDataFloats], NumCustomDataFloats * sizeof(float));
+
+		if (LastIndex < NumComponentInstances)
+		{
+			// With the compact payload every instance of the tile has the same transform, only the custom data moves
+			if (RenderMesh.Component->NumCustomDataFloats == NumCustomDataFloats)
+			{
+				FMemory::Memcpy(&RenderMesh.Component->PerInstanceSMCustomData[InstanceIndex * NumCustomDataFloats], &RenderMesh.InstanceCustomData[InstanceIndex * NumCustomDataFloats], NumCustomDataFloats * sizeof(float));
+			}
+			else
+			{
+				RenderMesh.Component->UpdateInstanceTransform(InstanceIndex, RenderMesh.InstanceXForms[InstanceIndex], true, true, true);
+			}
+		}
+	}
+
+	// Only ever remove the last instance so that no other instance changes index
+	if (LastIndex < NumComponentInstances)
+	{
+		RenderMesh.Component->RemoveInstance(LastIndex);
+	}
+
+	RenderMesh.InstanceEntities.Pop(false);
+	RenderMesh.InstanceXForms.Pop(false);
+	RenderMesh.InstanceCustomData.SetNum(RenderMesh.InstanceCustomData.Num() - FBoidsRenderMesh::NumCompactCustomDataFloats, false);
+
+	return MovedEntity;
+}
+
+void ABoidsRenderActor::GrowTileBounds(const int32 MeshIndex, const FVector& Location)
 {
-	if (MeshFragment && !RenderComponents.Contains(MeshFragment))
+	FBoidsRenderMesh& RenderMesh = RenderMeshes[MeshIndex];
+
+	RenderMesh.TileBounds += FBox(Location, Location).ExpandBy(TileSize * TileMargin);
+	RenderMesh.Component->SetTileBounds(RenderMesh.TileBounds);
+	UpdateTileInstanceTransform(RenderMesh);
+}
+
+void ABoidsRenderActor::UpdateTileInstanceTransform(FBoidsRenderMesh& RenderMesh)
+{
+	const UStaticMesh* Mesh = RenderMesh.Component->GetStaticMesh();
+	if (!Mesh)
 	{
-		UInstancedStaticMeshComponent* Component = NewObject<UInstancedStaticMeshComponent>(this);
-		Component->SetStaticMesh(MeshFragment->BoidMesh);
-		Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
-		Component->SetupAttachment(GetRootComponent());
-		Component->RegisterComponent();
-		
-		RenderComponents.Emplace(MeshFragment, Component);
+		return;
 	}
+
+	const FBox MeshBox = Mesh->GetBounds().GetBox();
+	const FBox TileBox = RenderMesh.Component->Bounds.GetBox();
+	const FVector Scale = TileBox.GetSize() / FVector::Max(MeshBox.GetSize(), FVector(KINDA_SMALL_NUMBER));
+
+	RenderMesh.TileInstanceXForm = FTransform(FQuat::Identity, TileBox.Min - MeshBox.Min * Scale, Scale);
+	RenderMesh.bTileInstanceXFormChanged = true;
 }
 
-UInstancedStaticMeshComponent* ABoidsRenderActor::GetRenderComponent(const FBoidsMeshFragment* MeshFragment)
+int32 ABoidsRenderActor::UpdateTileVisibility(TConstArrayView<FVector> ViewerLocations, const float MaxDistance, const bool bSkipHidden)
 {
-	if (MeshFragment && RenderComponents.Contains(MeshFragment))
+	const bool bCheckDistance = MaxDistance > 0.f && ViewerLocations.Num() > 0;
+	const float MaxDistanceSquared = FMath::Square(MaxDistance);
+
+	int32 NumUpdating = 0;
+	for (FBoidsRenderMesh& RenderMesh : RenderMeshes)
 	{
-		return RenderComponents[MeshFragment];
+		RenderMesh.bUpdating = !bSkipHidden || RenderMesh.Component->WasRecentlyRendered(TileRenderedTolerance);
+
+		if (RenderMesh.bUpdating && bCheckDistance)
+		{
+			RenderMesh.bUpdating = false;
+			for (const FVector& ViewerLocation : ViewerLocations)
+			{
+				if (RenderMesh.TileBounds.ComputeSquaredDistanceToPoint(ViewerLocation) < MaxDistanceSquared)
+				{
+					RenderMesh.bUpdating = true;
+					break;
+				}
+			}
+		}
+
+		NumUpdating += RenderMesh.bUpdating;
 	}
 
-	return nullptr;
+	return NumUpdating;
+}
+
+void ABoidsRenderActor::UpdateInstances(const bool bCompactPayload, uint32& NumAllocations)
+{
+	const int32 NumCustomDataFloats = bCompactPayload ? FBoidsRenderMesh::NumCompactCustomDataFloats : 0;
+
+	for (FBoidsRenderMesh& RenderMesh : RenderMeshes)
+	{
+		const int32 NumInstances = RenderMesh.InstanceXForms.Num();
+		const int32 NumComponentInstances = RenderMesh.Component->GetInstanceCount();
+
+		if (RenderMesh.Component->NumCustomDataFloats != NumCustomDataFloats)
+		{
+			RenderMesh.Component->SetNumCustomDataFloats(NumCustomDataFloats);
+
+			// The transforms were the boids' own until now
+			RenderMesh.bTileInstanceXFormChanged |= bCompactPayload;
+		}
+
+		// Add the instances of the boids that spawned since the last update
+		if (NumInstances > NumComponentInstances)
+		{
+			const int32 NumNewInstances = NumInstances - NumComponentInstances;
+
+			NumAllocations += NumNewInstances > RenderMesh.NewInstanceXForms.Max();
+			RenderMesh.NewInstanceXForms.Reset();
+			RenderMesh.NewInstanceXForms.Append(RenderMesh.InstanceXForms.GetData() + NumComponentInstances, NumNewInstances);
+
+			RenderMesh.Component->AddInstances(RenderMesh.NewInstanceXForms, false, true);
+		}
+
+		// The instances of a tile share one transform with the compact payload, it is only sent again once the tile grew.
+		// Hidden tiles are included, their instances would otherwise be culled with the old bounds once the tile is in view
+		if (bCompactPayload && RenderMesh.bTileInstanceXFormChanged)
+		{
+			RenderMesh.bTileInstanceXFormChanged = false;
+
+			for (FTransform& InstanceXForm : RenderMesh.InstanceXForms)
+			{
+				InstanceXForm = RenderMesh.TileInstanceXForm;
+			}
+
+			if (NumInstances > 0)
+			{
+				RenderMesh.Component->BatchUpdateInstancesTransforms(0, RenderMesh.InstanceXForms, true, true, false);
+			}
+		}
+
+		// Hidden tiles keep the transforms they were last sent
+		if (NumInstances == 0 || !RenderMesh.bUpdating)
+		{
+			continue;
+		}
+
+		if (bCompactPayload)
+		{
+			// The custom data of the whole tile is copied in one go and sent in a single update of the component, the transforms are left as they are
+			check(RenderMesh.Component->PerInstanceSMCustomData.Num() == RenderMesh.InstanceCustomData.Num());
+
+			FMemory::Memcpy(RenderMesh.Component->PerInstanceSMCustomData.GetData(), RenderMesh.InstanceCustomData.GetData(), RenderMesh.InstanceCustomData.Num() * sizeof(float));
+			RenderMesh.Component->MarkRenderStateDirty();
+		}
+		else
+		{
+			RenderMesh.Component->BatchUpdateInstancesTransforms(0, RenderMesh.InstanceXForms, true, true, false);
+		}
+	}
 }
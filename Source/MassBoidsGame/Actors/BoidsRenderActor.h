@@ -4,12 +4,82 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "MassEntityTypes.h"
 #include "Fragments/BoidsMeshFragment.h"
+#include "BoidsRender.h"
 #include "BoidsRenderActor.generated.h"
 
-class UInstancedStaticMeshComponent;
+class UBoidsTileMeshComponent;
 class UMassAgentComponent;
 
+/**
+ * Instances of a single boid mesh in one tile of the bounds. Each boid keeps the same instance until it is destroyed or leaves the tile,
+ * then the last instance takes its place
+ */
+struct FBoidsRenderMesh
+{
+	/** Number of custom data floats of each instance with the compact payload: location and packed heading */
+	static constexpr int32 NumCompactCustomDataFloats = 4;
+
+	/** Instanced StaticMesh Component that renders the boids of the mesh, its bounds are the tile bounds */
+	UBoidsTileMeshComponent* Component = nullptr;
+
+	/** Mesh the boids of the instances were spawned with */
+	const FBoidsMeshFragment* MeshFragment = nullptr;
+
+	/** Tile of the instances */
+	int32 TileIndex = INDEX_NONE;
+
+	/**
+	 * Bounds of the tile with a margin, boids only move to another tile once they leave it. Tiles on the edge grow to hold the boids
+	 * that go past the bounds of all tiles
+	 */
+	FBox TileBounds = FBox(ForceInit);
+
+	/** Whether the transforms of the instances are written and sent this frame, tiles that are hidden or too far are left as they are */
+	bool bUpdating = true;
+
+	/** Entity of each instance */
+	TArray<FMassEntityHandle> InstanceEntities;
+
+	/** Transform of each instance, written every frame and sent to the component in one go */
+	TArray<FTransform> InstanceXForms;
+
+	/** Transforms of the instances that are not in the component yet, reused every frame */
+	TArray<FTransform> NewInstanceXForms;
+
+	/** Location and packed heading of each instance, written every frame instead of the transforms with the compact payload */
+	TArray<float> InstanceCustomData;
+
+	/**
+	 * Transform of every instance with the compact payload. The material places the mesh from the custom data, so the transform only
+	 * stretches the mesh bounds over the bounds of the tile component, and every instance is culled with its tile
+	 */
+	FTransform TileInstanceXForm = FTransform::Identity;
+
+	/** Whether the tile bounds changed since the instance transforms were last sent with the compact payload */
+	bool bTileInstanceXFormChanged = false;
+
+	FORCEINLINE void SetInstanceTransform(const int32 InstanceIndex, const FVector& Location, const FVector& Velocity)
+	{
+		InstanceXForms[InstanceIndex] = FTransform(BoidsCore::GetHeadingRotation(Velocity), Location, FVector::OneVector);
+	}
+
+	FORCEINLINE void SetInstanceCustomData(const int32 InstanceIndex, const FVector& Location, const FVector& Velocity)
+	{
+		float* CustomData = InstanceCustomData.GetData() + InstanceIndex * NumCompactCustomDataFloats;
+		CustomData[0] = Location.X;
+		CustomData[1] = Location.Y;
+		CustomData[2] = Location.Z;
+		CustomData[3] = BoidsCore::PackHeading(Velocity);
+	}
+
+	FORCEINLINE void SetInstanceTileTransform(const int32 InstanceIndex)
+	{
+		InstanceXForms[InstanceIndex] = TileInstanceXForm;
+	}
+};
+
 /**
  * Actor responsible for Instanced Rendering of the Boids
  */
@@ -18,15 +88,90 @@ class MASSBOIDSGAME_API ABoidsRenderActor : public AActor
 {
 	GENERATED_BODY()
 
+	/** Instances of every boid mesh in every tile */
+	TArray<FBoidsRenderMesh> RenderMeshes;
+
+	/** Index of each mesh and tile in RenderMeshes, only used when boids spawn or change tiles */
+	TMap<TPair<const FBoidsMeshFragment*, int32>, int32> RenderMeshIndices;
+
+	/** Corner of the first tile */
+	FVector TilesOrigin;
+
+	/** Size of a single tile along each axis */
+	FVector TileSize;
+
+	/** Number of tiles along each axis */
+	int32 TilesPerAxis;
+
+	/** Whether boids spawned without an instance, or left their tile and have to be moved to an instance of their new tile */
+	bool bHasPendingInstances;
+
+	/** Stretch the mesh bounds over the bounds of the tile component for the instances of the compact payload */
+	static void UpdateTileInstanceTransform(FBoidsRenderMesh& RenderMesh);
+
 public:
+	
+	ABoidsRenderActor(const FObjectInitializer& ObjectInitializer);
+
+	/** Split the bounds of the boids in tiles along each axis, every mesh gets a render component per tile. Ignored once render meshes exist */
+	void SetupTiles(const FBox& Bounds, const int32 InTilesPerAxis);
+
+	/** Get the tile containing a location, locations outside of the bounds belong to the closest tile */
+	FORCEINLINE int32 GetTileIndex(const FVector& Location) const
+	{
+		const FVector TileCoords = (Location - TilesOrigin) / TileSize;
+		const int32 X = FMath::Clamp(FMath::FloorToInt(TileCoords.X), 0, TilesPerAxis - 1);
+		const int32 Y = FMath::Clamp(FMath::FloorToInt(TileCoords.Y), 0, TilesPerAxis - 1);
+		const int32 Z = FMath::Clamp(FMath::FloorToInt(TileCoords.Z), 0, TilesPerAxis - 1);
+
+		return (Z * TilesPerAxis + Y) * TilesPerAxis + X;
+	}
+
+	/** Get the index of the render mesh of a mesh fragment in a tile, creating its render component the first time */
+	int32 GetOrCreateRenderMesh(const FBoidsMeshFragment* MeshFragment, const int32 TileIndex);
+
+	FORCEINLINE FBoidsRenderMesh& GetRenderMesh(const int32 MeshIndex)
+	{
+		return RenderMeshes[MeshIndex];
+	}
+
+	FORCEINLINE int32 GetNumRenderMeshes() const
+	{
+		return RenderMeshes.Num();
+	}
+
+	/** Give an entity a new instance of a mesh. NumAllocations is incremented if a buffer had to grow */
+	int32 AddInstance(const int32 MeshIndex, const FMassEntityHandle Entity, uint32& NumAllocations);
+
+	/** Remove an instance by moving the last instance in its place. Returns the entity of the moved instance, if any */
+	FMassEntityHandle RemoveInstance(const int32 MeshIndex, const int32 InstanceIndex);
+
+	/** Grow the bounds of a tile to hold a boid that left them but has no other tile to go to, with the same margin as the tile */
+	void GrowTileBounds(const int32 MeshIndex, const FVector& Location);
+
+	/** Note that boids spawned or left their tile, so they need a new instance */
+	FORCEINLINE void SetHasPendingInstances()
+	{
+		bHasPendingInstances = true;
+	}
+
+	/** Whether boids need a new instance since the last call */
+	FORCEINLINE bool ConsumePendingInstances()
+	{
+		const bool bPending = bHasPendingInstances;
+		bHasPendingInstances = false;
+		return bPending;
+	}
 
 	/**
-	 * Instanced StaticMesh Component that renders all the boids
+	 * Pick the tiles updated next frame. Tiles are skipped when their component was not rendered recently if bSkipHidden is set,
+	 * or when they are farther than MaxDistance from every viewer if MaxDistance is above zero. Returns the number of tiles updated
 	 */
-	TMap<const FBoidsMeshFragment*, UInstancedStaticMeshComponent*> RenderComponents;
-	
-	ABoidsRenderActor(const FObjectInitializer& ObjectInitializer);
+	int32 UpdateTileVisibility(TConstArrayView<FVector> ViewerLocations, const float MaxDistance, const bool bSkipHidden);
 
-	void CreateNewRenderComponent(const FBoidsMeshFragment* MeshFragment);
-	UInstancedStaticMeshComponent* GetRenderComponent(const FBoidsMeshFragment* MeshFragment);
+	/**
+	 * Add the new instances to their components and send the transforms of all instances of the updated tiles, or only their custom data
+	 * in one copy with the compact payload. NumAllocations is incremented if a buffer had to grow
+	 */
+	void UpdateInstances(const bool bCompactPayload, uint32& NumAllocations);
 };
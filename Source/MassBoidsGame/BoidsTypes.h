@@ -3,8 +3,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "BoidsCoreTypes.h"
+
+DECLARE_STATS_GROUP(TEXT("Boids"), STATGROUP_Boids, STATCAT_Advanced);
 
 namespace MassBoidsGame::ProcessorGroupNames
 {
-	const FName Boids = FName(TEXT("Boids"));	
+	const FName Boids = FName(TEXT("Boids"));
 }
@@ -0,0 +1,136 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsBakeObstaclesCommandlet.h"
+#include "BoidsDistanceField.h"
+#include "Config/BoidsSettings.h"
+
+// Engine
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsBakeObstacles, Log, All);
+
+UBoidsBakeObstaclesCommandlet::UBoidsBakeObstaclesCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBoidsBakeObstaclesCommandlet::Main(const FString& Params)
+{
+	const UBoidsSettings* Settings = GetDefault<UBoidsSettings>();
+
+	FString MapPath = TEXT("/Game/StarterContent/Maps/StarterMap");
+	int32 Resolution = 32;
+	FString OutputFile = Settings->ObstacleFieldFile;
+
+	FParse::Value(*Params, TEXT("Map="), MapPath);
+	FParse::Value(*Params, TEXT("Resolution="), Resolution);
+	FParse::Value(*Params, TEXT("Output="), OutputFile);
+
+	if (Resolution < 2 || Resolution > 512 || OutputFile.IsEmpty())
+	{
+		UE_LOG(LogBoidsBakeObstacles, Error, TEXT("Invalid bake parameters"));
+		return 1;
+	}
+
+	const FString WorldPath = MapPath.Contains(TEXT(".")) ? MapPath : MapPath + TEXT(".") + FPackageName::GetShortName(MapPath);
+	UWorld* World = LoadObject<UWorld>(nullptr, *WorldPath);
+	if (!World)
+	{
+		UE_LOG(LogBoidsBakeObstacles, Error, TEXT("Could not load map %s"), *MapPath);
+		return 1;
+	}
+
+	// Collision is only queried once the components are registered with a physics scene
+	World->AddToRoot();
+	World->WorldType = EWorldType::Editor;
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Editor);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitWorld(UWorld::InitializationValues()
+		.ShouldSimulatePhysics(false)
+		.EnableTraceCollision(true)
+		.CreateNavigation(false)
+		.CreateAISystem(false)
+		.AllowAudioPlayback(false)
+		.CreatePhysicsScene(true));
+	World->UpdateWorldComponents(true, false);
+
+	// Same bounds the boids are kept in, with the turn back offset they can overshoot by
+	const FVector HalfExtent = FVector(Settings->Extent / 2.f + Settings->TurnBackOffset);
+	const FBox Bounds = FBox(Settings->Origin - HalfExtent, Settings->Origin + HalfExtent);
+
+	TArray<const UPrimitiveComponent*> Obstacles;
+	TArray<FBox> ObstacleBounds;
+	for (TObjectIterator<UPrimitiveComponent> It; It; ++It)
+	{
+		const UPrimitiveComponent* Component = *It;
+		if (Component->GetWorld() == World && Component->IsRegistered() && Component->IsCollisionEnabled())
+		{
+			Obstacles.Add(Component);
+			ObstacleBounds.Add(Component->Bounds.GetBox());
+		}
+	}
+
+	UE_LOG(LogBoidsBakeObstacles, Display, TEXT("Baking %d obstacles of %s at %d samples per axis"), Obstacles.Num(), *MapPath, Resolution);
+
+	// Samples farther than this from every obstacle do not matter, boids only avoid obstacles they get close to
+	const float MaxDistance = Bounds.GetSize().GetMax();
+
+	FBoidsDistanceField ObstacleField;
+	ObstacleField.Build(Bounds, FIntVector(Resolution), [&Obstacles, &ObstacleBounds, MaxDistance] (const FVector& Location)
+	{
+		float Distance = MaxDistance;
+		for (int32 Ndx = 0; Ndx < Obstacles.Num(); Ndx++)
+		{
+			// The bounds are never farther than the collision, so obstacles whose bounds are farther than the closest one so far are skipped
+			if (ObstacleBounds[Ndx].ComputeSquaredDistanceToPoint(Location) >= FMath::Square(Distance))
+			{
+				continue;
+			}
+
+			FVector ClosestPoint;
+			const float ObstacleDistance = Obstacles[Ndx]->GetDistanceToCollision(Location, ClosestPoint);
+			if (ObstacleDistance >= 0.f)
+			{
+				Distance = FMath::Min(Distance, ObstacleDistance);
+			}
+		}
+
+		return Distance;
+	});
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	if (!ObstacleField.IsValid())
+	{
+		UE_LOG(LogBoidsBakeObstacles, Error, TEXT("Could not build the obstacle field"));
+		return 1;
+	}
+
+	TArray<uint8> Data;
+	ObstacleField.Save(Data);
+
+	const FString OutputPath = FPaths::Combine(FPaths::ProjectContentDir(), OutputFile);
+	if (!FFileHelper::SaveArrayToFile(Data, *OutputPath))
+	{
+		UE_LOG(LogBoidsBakeObstacles, Error, TEXT("Could not write the obstacle field to %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogBoidsBakeObstacles, Display, TEXT("Wrote %d bytes to %s"), Data.Num(), *FPaths::ConvertRelativePathToFull(OutputPath));
+	return 0;
+}
@@ -0,0 +1,30 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BoidsBakeObstaclesCommandlet.generated.h"
+
+/**
+ * Bakes the distance to the collision of a map into the obstacle field boids avoid.
+ *
+ * Usage: UnrealEditor-Cmd MassBoidsGame.uproject -run=BoidsBakeObstacles -unattended
+ *        [-Map=/Game/StarterContent/Maps/StarterMap] [-Resolution=32] [-Output=Boids/Obstacles.bsdf]
+ *
+ * The field covers the boids bounds of the settings, and is written relative to the project content directory where the boids subsystem
+ * loads it from. Collision only gives the distance outside of obstacles, so samples inside of them are zero.
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsBakeObstaclesCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UBoidsBakeObstaclesCommandlet(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// ~ end UCommandlet interface
+};
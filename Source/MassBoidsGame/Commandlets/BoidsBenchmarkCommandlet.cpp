@@ -0,0 +1,592 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsBenchmarkCommandlet.h"
+#include "BoidsDistanceField.h"
+#include "BoidsSnapshot.h"
+#include "Actors/BoidsRenderActor.h"
+#include "Components/BoidsTileMeshComponent.h"
+#include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsSpeedFragment.h"
+#include "Config/BoidsSettings.h"
+#include "Config/BoidsSnapshotSpawnDataGenerator.h"
+#include "Config/BoidsSpawnDataGenerator.h"
+#include "Processors/BoidsBoundsProcessor.h"
+#include "Processors/BoidsLODProcessor.h"
+#include "Processors/BoidsMoveProcessor.h"
+#include "Processors/BoidsObstacleProcessor.h"
+#include "Processors/BoidsRenderPrepProcessor.h"
+#include "Processors/BoidsRenderProcessor.h"
+#include "Processors/BoidsRuleProcessor.h"
+#include "Processors/BoidsSpawnProcessor.h"
+#include "Subsystems/BoidsSubsystem.h"
+
+// Engine
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "MassEntityConfigAsset.h"
+#include "MassEntitySubsystem.h"
+#include "MassExecutor.h"
+#include "MassMovementFragments.h"
+#include "MassSpawnerSubsystem.h"
+#include "MassSpawnerTypes.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsBenchmark, Log, All);
+
+namespace
+{
+	/** Time spent in a single step of the boids pipeline, one sample per measured frame */
+	struct FBoidsBenchmarkStep
+	{
+		FString Name;
+		TArray<double> Samples;
+		double Mean = 0.0;
+		double P50 = 0.0;
+		double P99 = 0.0;
+
+		explicit FBoidsBenchmarkStep(const TCHAR* InName)
+			: Name(InName)
+		{
+		}
+
+		/** Compute the statistics of the samples, in milliseconds */
+		void Finish()
+		{
+			if (Samples.Num() == 0)
+			{
+				return;
+			}
+
+			Samples.Sort();
+
+			double Sum = 0.0;
+			for (const double Sample : Samples)
+			{
+				Sum += Sample;
+			}
+
+			Mean = Sum / Samples.Num() * 1000.0;
+			P50 = Samples[FMath::Min((int32)(Samples.Num() * 0.50), Samples.Num() - 1)] * 1000.0;
+			P99 = Samples[FMath::Min((int32)(Samples.Num() * 0.99), Samples.Num() - 1)] * 1000.0;
+		}
+	};
+
+	double RunProcessor(UMassProcessor* Processor, UMassEntitySubsystem& EntitySubsystem, const float DeltaTime)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+
+		FMassProcessingContext ProcessingContext(EntitySubsystem, DeltaTime);
+		UE::Mass::Executor::RunProcessorsView(MakeArrayView(&Processor, 1), ProcessingContext);
+
+		return FPlatformTime::Seconds() - StartTime;
+	}
+
+	/**
+	 * Check that every render instance, and the data its component got, matches the boid it belongs to, and that the bounds of its tile
+	 * component hold the boid. With the compact payload every instance of a tile has to share the transform of the tile, with bounds that cover the component.
+	 * Returns the number of mismatches
+	 */
+	int32 VerifyRenderInstances(ABoidsRenderActor& RenderActor, UMassEntitySubsystem& EntitySubsystem, const bool bCompactPayload)
+	{
+		int32 NumMismatches = 0;
+
+		for (int32 MeshNdx = 0; MeshNdx < RenderActor.GetNumRenderMeshes(); MeshNdx++)
+		{
+			const FBoidsRenderMesh& RenderMesh = RenderActor.GetRenderMesh(MeshNdx);
+			const UBoidsTileMeshComponent* Component = RenderMesh.Component;
+
+			if (Component->GetInstanceCount() != RenderMesh.InstanceEntities.Num())
+			{
+				UE_LOG(LogBoidsBenchmark, Error, TEXT("Mesh %d: %d component instances for %d boids"), MeshNdx, Component->GetInstanceCount(), RenderMesh.InstanceEntities.Num());
+				++NumMismatches;
+				continue;
+			}
+
+			const FBox MeshBox = Component->GetStaticMesh() ? Component->GetStaticMesh()->GetBounds().GetBox() : FBox(FVector::ZeroVector, FVector::ZeroVector);
+			const FBox ComponentBox = Component->Bounds.GetBox();
+
+			for (int32 InstanceNdx = 0; InstanceNdx < RenderMesh.InstanceEntities.Num(); InstanceNdx++)
+			{
+				const FMassEntityHandle Entity = RenderMesh.InstanceEntities[InstanceNdx];
+				const FVector Location = EntitySubsystem.GetFragmentDataChecked<FBoidsLocationFragment>(Entity).Location;
+				const FVector Velocity = EntitySubsystem.GetFragmentDataChecked<FMassVelocityFragment>(Entity).Value;
+
+				bool bMatches;
+				if (bCompactPayload)
+				{
+					const int32 NumCustomDataFloats = FBoidsRenderMesh::NumCompactCustomDataFloats;
+					const float* CustomData = &Component->PerInstanceSMCustomData[InstanceNdx * NumCustomDataFloats];
+					const FVector Direction = Velocity.GetSafeNormal(SMALL_NUMBER, FVector::ForwardVector);
+
+					FTransform InstanceXForm;
+					Component->GetInstanceTransform(InstanceNdx, InstanceXForm, true);
+
+					// Every instance shares the transform of the tile, its bounds have to cover the component bounds so no boid of the tile is culled.
+					// With a margin for the rounding of the transform
+					const FBox InstanceBox = MeshBox.TransformBy(InstanceXForm).ExpandBy(1.f);
+
+					bMatches = Component->NumCustomDataFloats == NumCustomDataFloats
+						&& FVector(CustomData[0], CustomData[1], CustomData[2]).Equals(Location, KINDA_SMALL_NUMBER)
+						&& (BoidsCore::UnpackHeading(CustomData[3]) | Direction) >= 1.f - 1.e-5f
+						&& InstanceXForm.Equals(RenderMesh.TileInstanceXForm, 0.1f)
+						&& InstanceBox.IsInsideOrOn(ComponentBox.Min) && InstanceBox.IsInsideOrOn(ComponentBox.Max);
+				}
+				else
+				{
+					FTransform InstanceXForm;
+					Component->GetInstanceTransform(InstanceNdx, InstanceXForm, true);
+
+					bMatches = InstanceXForm.GetLocation().Equals(Location, 0.1f)
+						&& FMath::Abs(InstanceXForm.GetRotation() | BoidsCore::GetHeadingRotation(Velocity)) >= 1.f - 1.e-4f;
+				}
+
+				// The tile is culled with the bounds of its component, which have to hold every boid of the tile
+				bMatches &= Component->GetTileBounds().IsInsideOrOn(Location)
+					&& ComponentBox.IsInsideOrOn(Component->GetTileBounds().Min)
+					&& ComponentBox.IsInsideOrOn(Component->GetTileBounds().Max);
+
+				if (!bMatches)
+				{
+					UE_LOG(LogBoidsBenchmark, Error, TEXT("Mesh %d instance %d does not match boid %d at %s"), MeshNdx, InstanceNdx, Entity.Index, *Location.ToString());
+					++NumMismatches;
+				}
+			}
+		}
+
+		return NumMismatches;
+	}
+
+	/** Check that boids spawned from a snapshot have the state they were saved with. Returns the number of mismatches */
+	int32 VerifySnapshotBoids(const FBoidsSnapshotSpawnData& SpawnData, TConstArrayView<FMassEntityHandle> Entities, UMassEntitySubsystem& EntitySubsystem)
+	{
+		if (Entities.Num() != SpawnData.Boids.Num())
+		{
+			UE_LOG(LogBoidsBenchmark, Error, TEXT("Spawned %d boids from a snapshot of %d boids"), Entities.Num(), SpawnData.Boids.Num());
+			return 1;
+		}
+
+		int32 NumMismatches = 0;
+
+		for (int32 Ndx = 0; Ndx < Entities.Num(); Ndx++)
+		{
+			const int32 SnapshotNdx = SpawnData.Boids[Ndx];
+			const FVector Location = EntitySubsystem.GetFragmentDataChecked<FBoidsLocationFragment>(Entities[Ndx]).Location;
+			const FVector Velocity = EntitySubsystem.GetFragmentDataChecked<FMassVelocityFragment>(Entities[Ndx]).Value;
+			const float MaxSpeed = EntitySubsystem.GetFragmentDataChecked<FBoidsSpeedFragment>(Entities[Ndx]).MaxSpeed;
+
+			if (Location != SpawnData.Snapshot->GetLocation(SnapshotNdx) || Velocity != SpawnData.Snapshot->GetVelocity(SnapshotNdx) || MaxSpeed != SpawnData.Snapshot->GetSpeed(SnapshotNdx))
+			{
+				UE_LOG(LogBoidsBenchmark, Error, TEXT("Boid %d at %s does not match snapshot boid %d at %s"), Entities[Ndx].Index, *Location.ToString(), SnapshotNdx, *SpawnData.Snapshot->GetLocation(SnapshotNdx).ToString());
+				++NumMismatches;
+			}
+		}
+
+		return NumMismatches;
+	}
+
+	/** Check that retired boids stayed where they were while dormant, so that no processor ran on them. Returns the number of mismatches */
+	int32 VerifyDormantBoids(TConstArrayView<FMassEntityHandle> Entities, TConstArrayView<FVector> Locations, UMassEntitySubsystem& EntitySubsystem)
+	{
+		int32 NumMismatches = 0;
+
+		for (int32 Ndx = 0; Ndx < Entities.Num(); Ndx++)
+		{
+			const FVector Location = EntitySubsystem.GetFragmentDataChecked<FBoidsLocationFragment>(Entities[Ndx]).Location;
+			if (Location != Locations[Ndx])
+			{
+				UE_LOG(LogBoidsBenchmark, Error, TEXT("Dormant boid %d moved from %s to %s"), Entities[Ndx].Index, *Locations[Ndx].ToString(), *Location.ToString());
+				++NumMismatches;
+			}
+		}
+
+		return NumMismatches;
+	}
+
+	/** Check that spawning reactivated the retired boids instead of creating new ones, at the spawn transforms. Returns the number of mismatches */
+	int32 VerifyReactivatedBoids(TConstArrayView<FMassEntityHandle> Retired, TConstArrayView<FMassEntityHandle> Reactivated, TConstArrayView<FTransform> Transforms, UMassEntitySubsystem& EntitySubsystem)
+	{
+		if (Reactivated.Num() != Retired.Num())
+		{
+			UE_LOG(LogBoidsBenchmark, Error, TEXT("Spawned %d boids for %d retired boids"), Reactivated.Num(), Retired.Num());
+			return 1;
+		}
+
+		int32 NumMismatches = 0;
+
+		for (int32 Ndx = 0; Ndx < Reactivated.Num(); Ndx++)
+		{
+			const FVector Location = EntitySubsystem.GetFragmentDataChecked<FBoidsLocationFragment>(Reactivated[Ndx]).Location;
+			if (!Retired.Contains(Reactivated[Ndx]) || Location != Transforms[Ndx].GetLocation())
+			{
+				UE_LOG(LogBoidsBenchmark, Error, TEXT("Spawned boid %d at %s was not reactivated at %s"), Reactivated[Ndx].Index, *Location.ToString(), *Transforms[Ndx].GetLocation().ToString());
+				++NumMismatches;
+			}
+		}
+
+		return NumMismatches;
+	}
+}
+
+UBoidsBenchmarkCommandlet::UBoidsBenchmarkCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBoidsBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 NumBoids = 100000;
+	int32 NumFrames = 300;
+	int32 NumWarmupFrames = 30;
+	int32 Seed = 0;
+	float DeltaTime = 1.f / 60.f;
+	FString ConfigPath = TEXT("/Game/BP_BoidConfig.BP_BoidConfig");
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("BoidsBenchmark.csv");
+	FString LoadSnapshotPath;
+	FString SaveSnapshotPath;
+	int32 WaveSize = 0;
+	int32 WaveInterval = 30;
+
+	FParse::Value(*Params, TEXT("Boids="), NumBoids);
+	FParse::Value(*Params, TEXT("Frames="), NumFrames);
+	FParse::Value(*Params, TEXT("Warmup="), NumWarmupFrames);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("DeltaTime="), DeltaTime);
+	FParse::Value(*Params, TEXT("Config="), ConfigPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("LoadSnapshot="), LoadSnapshotPath);
+	FParse::Value(*Params, TEXT("SaveSnapshot="), SaveSnapshotPath);
+	FParse::Value(*Params, TEXT("WaveSize="), WaveSize);
+	FParse::Value(*Params, TEXT("WaveInterval="), WaveInterval);
+
+	const bool bCompactPayload = FParse::Param(*Params, TEXT("CompactRender"));
+	GetMutableDefault<UBoidsSettings>()->RenderPayload = bCompactPayload ? EBoidsRenderPayload::Compact : EBoidsRenderPayload::Transform;
+
+	// Nothing is ever rendered without a viewport, every tile has to be updated for the results to mean anything
+	GetMutableDefault<UBoidsSettings>()->bSkipHiddenRenderTiles = false;
+
+	const bool bSyntheticObstacles = FParse::Param(*Params, TEXT("SyntheticObstacles"));
+
+	if (FParse::Param(*Params, TEXT("FlockField")))
+	{
+		GetMutableDefault<UBoidsSettings>()->bFlockField = true;
+	}
+
+	if (NumBoids <= 0 || NumFrames <= 0 || NumWarmupFrames < 0 || DeltaTime <= 0.f || WaveSize < 0 || WaveInterval <= 0)
+	{
+		UE_LOG(LogBoidsBenchmark, Error, TEXT("Invalid benchmark parameters"));
+		return 1;
+	}
+
+	UMassEntityConfigAsset* EntityConfig = LoadObject<UMassEntityConfigAsset>(nullptr, *ConfigPath);
+	if (!EntityConfig)
+	{
+		UE_LOG(LogBoidsBenchmark, Error, TEXT("Could not load entity config %s"), *ConfigPath);
+		return 1;
+	}
+
+	// Create a game world to hold the Mass subsystems. The world is never ticked, the processors are run by hand below
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("BoidsBenchmark"));
+	check(World);
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	UMassEntitySubsystem* EntitySubsystem = UWorld::GetSubsystem<UMassEntitySubsystem>(World);
+	UMassSpawnerSubsystem* SpawnerSubsystem = UWorld::GetSubsystem<UMassSpawnerSubsystem>(World);
+	UBoidsSubsystem* BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(World);
+	check(EntitySubsystem && SpawnerSubsystem && BoidsSubsystem);
+
+	const FMassEntityTemplate& EntityTemplate = EntityConfig->GetConfig().GetOrCreateEntityTemplate(*World, *EntityConfig);
+	if (!EntityTemplate.IsValid())
+	{
+		UE_LOG(LogBoidsBenchmark, Error, TEXT("Could not create an entity template from %s"), *ConfigPath);
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		return 1;
+	}
+
+	// Replace the obstacles of the project by a sphere in the middle of the bounds, so that avoidance is measured with a known field
+	if (bSyntheticObstacles)
+	{
+		GetMutableDefault<UBoidsSettings>()->bObstacleAvoidance = true;
+
+		const UBoidsSettings* Settings = GetDefault<UBoidsSettings>();
+		const FVector HalfExtent = FVector(Settings->Extent / 2.f + Settings->TurnBackOffset);
+		const FVector SphereCenter = Settings->Origin;
+		const float SphereRadius = Settings->Extent / 4.f;
+
+		FBoidsDistanceField ObstacleField;
+		ObstacleField.Build(FBox(SphereCenter - HalfExtent, SphereCenter + HalfExtent), FIntVector(32), [&SphereCenter, SphereRadius] (const FVector& Location)
+		{
+			return FVector::Dist(Location, SphereCenter) - SphereRadius;
+		});
+
+		BoidsSubsystem->SetObstacleField(MoveTemp(ObstacleField));
+	}
+
+	int32 NumMismatches = 0;
+	TArray<FMassEntityHandle> ActiveBoids;
+
+	// Start from a flock that was already simulated, every boid of the snapshot is spawned whatever the number of boids is
+	if (!LoadSnapshotPath.IsEmpty())
+	{
+		const TSharedRef<FBoidsSnapshot> Snapshot = MakeShared<FBoidsSnapshot>();
+
+		const double StartTime = FPlatformTime::Seconds();
+		if (!Snapshot->Open(*LoadSnapshotPath))
+		{
+			UE_LOG(LogBoidsBenchmark, Error, TEXT("Could not open the snapshot %s"), *LoadSnapshotPath);
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(false);
+			return 1;
+		}
+
+		TArray<FBoidsSnapshotSpawnData> SpawnData;
+		UBoidsSnapshotSpawnDataGenerator::BuildSpawnData(Snapshot, 1, SpawnData);
+
+		SpawnerSubsystem->SpawnEntities(EntityTemplate.GetTemplateID(), SpawnData[0].Boids.Num(), FConstStructView::Make(SpawnData[0]), UBoidsSpawnProcessor::StaticClass(), ActiveBoids);
+
+		UE_LOG(LogBoidsBenchmark, Display, TEXT("Spawned %d boids from %s in %.3f ms"), ActiveBoids.Num(), *LoadSnapshotPath, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+		NumBoids = ActiveBoids.Num();
+		NumMismatches += VerifySnapshotBoids(SpawnData[0], ActiveBoids, *EntitySubsystem);
+	}
+	// Spawn the boids the same way the spawn data generator does, from the benchmark seed so every run starts from the same flock
+	else
+	{
+		const UBoidsSettings* Settings = GetDefault<UBoidsSettings>();
+		const FVector HalfExtent = FVector(Settings->Extent / 2.f + Settings->TurnBackOffset);
+
+		FMassTransformsSpawnData SpawnData;
+		UBoidsSpawnDataGenerator::GenerateTransforms(FBox(-HalfExtent, HalfExtent), Seed, NumBoids, SpawnData.Transforms);
+
+		SpawnerSubsystem->SpawnEntities(EntityTemplate.GetTemplateID(), NumBoids, FConstStructView::Make(SpawnData), UBoidsSpawnProcessor::StaticClass(), ActiveBoids);
+	}
+
+	UBoidsLODProcessor* LODProcessor = NewObject<UBoidsLODProcessor>(this);
+	UBoidsRuleProcessor* RuleProcessor = NewObject<UBoidsRuleProcessor>(this);
+	UBoidsBoundsProcessor* BoundsProcessor = NewObject<UBoidsBoundsProcessor>(this);
+	UBoidsObstacleProcessor* ObstacleProcessor = NewObject<UBoidsObstacleProcessor>(this);
+	UBoidsMoveProcessor* MoveProcessor = NewObject<UBoidsMoveProcessor>(this);
+	UBoidsRenderPrepProcessor* RenderPrepProcessor = NewObject<UBoidsRenderPrepProcessor>(this);
+	UBoidsRenderProcessor* RenderProcessor = NewObject<UBoidsRenderProcessor>(this);
+
+	LODProcessor->Initialize(*World);
+	RuleProcessor->Initialize(*World);
+	BoundsProcessor->Initialize(*World);
+	ObstacleProcessor->Initialize(*World);
+	MoveProcessor->Initialize(*World);
+	RenderPrepProcessor->Initialize(*World);
+	RenderProcessor->Initialize(*World);
+
+	FBoidsBenchmarkStep Frame(TEXT("Frame"));
+	FBoidsBenchmarkStep LOD(TEXT("LOD"));
+	FBoidsBenchmarkStep Rules(TEXT("Rules"));
+	FBoidsBenchmarkStep GatherBoids(TEXT("GatherBoids"));
+	FBoidsBenchmarkStep SetupBoidsGrid(TEXT("SetupBoidsGrid"));
+	FBoidsBenchmarkStep RunBoidsRules(TEXT("RunBoidsRules"));
+	FBoidsBenchmarkStep RunFlockField(TEXT("RunFlockField"));
+	FBoidsBenchmarkStep ScatterBoids(TEXT("ScatterBoids"));
+	FBoidsBenchmarkStep Bounds(TEXT("Bounds"));
+	FBoidsBenchmarkStep Obstacles(TEXT("Obstacles"));
+	FBoidsBenchmarkStep Move(TEXT("Move"));
+	FBoidsBenchmarkStep RenderPrep(TEXT("RenderPrep"));
+	FBoidsBenchmarkStep Render(TEXT("Render"));
+	FBoidsBenchmarkStep RetireWave(TEXT("RetireWave"));
+	FBoidsBenchmarkStep SpawnWave(TEXT("SpawnWave"));
+
+	// Waves of boids leave and come back through the pool of the boids subsystem. Every wave the boids that left with the previous one
+	// are spawned again, which reactivates them, and the oldest boids leave until the next wave
+	WaveSize = FMath::Min(WaveSize, ActiveBoids.Num());
+
+	const FMassEntityTemplateID TemplateID = EntityTemplate.GetTemplateID();
+	const FVector WaveHalfExtent = FVector(GetDefault<UBoidsSettings>()->Extent / 2.f);
+
+	TArray<FMassEntityHandle> RetiredBoids;
+	TArray<FVector> RetiredLocations;
+	TArray<FMassEntityHandle> ReactivatedBoids;
+	TArray<FTransform> WaveTransforms;
+
+	UE_LOG(LogBoidsBenchmark, Display, TEXT("Running %d boids for %d frames (%d warmup frames, seed %d, %s render payload, %s obstacles)"),
+		NumBoids, NumFrames, NumWarmupFrames, Seed, bCompactPayload ? TEXT("compact") : TEXT("transform"),
+		BoidsSubsystem->GetObstacleField().IsValid() ? (bSyntheticObstacles ? TEXT("synthetic") : TEXT("baked")) : TEXT("no"));
+
+	for (int32 FrameNdx = 0; FrameNdx < NumWarmupFrames + NumFrames; FrameNdx++)
+	{
+		const bool bWave = WaveSize > 0 && FrameNdx > 0 && FrameNdx % WaveInterval == 0;
+		double RetireTime = 0.0;
+		double SpawnTime = 0.0;
+
+		if (bWave)
+		{
+			if (RetiredBoids.Num() > 0)
+			{
+				NumMismatches += VerifyDormantBoids(RetiredBoids, RetiredLocations, *EntitySubsystem);
+
+				UBoidsSpawnDataGenerator::GenerateTransforms(FBox(-WaveHalfExtent, WaveHalfExtent), Seed + FrameNdx, RetiredBoids.Num(), WaveTransforms);
+
+				ReactivatedBoids.Reset();
+				const double SpawnStartTime = FPlatformTime::Seconds();
+				BoidsSubsystem->SpawnBoids(TemplateID, WaveTransforms, ReactivatedBoids);
+				SpawnTime = FPlatformTime::Seconds() - SpawnStartTime;
+
+				NumMismatches += VerifyReactivatedBoids(RetiredBoids, ReactivatedBoids, WaveTransforms, *EntitySubsystem);
+				ActiveBoids.Append(ReactivatedBoids);
+			}
+
+			RetiredBoids.Reset();
+			RetiredBoids.Append(ActiveBoids.GetData(), WaveSize);
+			ActiveBoids.RemoveAt(0, WaveSize, false);
+
+			RetiredLocations.Reset();
+			for (const FMassEntityHandle Entity : RetiredBoids)
+			{
+				RetiredLocations.Add(EntitySubsystem->GetFragmentDataChecked<FBoidsLocationFragment>(Entity).Location);
+			}
+
+			const double RetireStartTime = FPlatformTime::Seconds();
+			BoidsSubsystem->RetireBoids(TemplateID, RetiredBoids);
+			RetireTime = FPlatformTime::Seconds() - RetireStartTime;
+
+			if (BoidsSubsystem->GetNumDormantBoids(TemplateID) != RetiredBoids.Num())
+			{
+				UE_LOG(LogBoidsBenchmark, Error, TEXT("%d dormant boids after retiring %d boids"), BoidsSubsystem->GetNumDormantBoids(TemplateID), RetiredBoids.Num());
+				++NumMismatches;
+			}
+		}
+
+		const double LODTime = RunProcessor(LODProcessor, *EntitySubsystem, DeltaTime);
+		const double RuleTime = RunProcessor(RuleProcessor, *EntitySubsystem, DeltaTime);
+		const double BoundsTime = RunProcessor(BoundsProcessor, *EntitySubsystem, DeltaTime);
+		const double ObstacleTime = RunProcessor(ObstacleProcessor, *EntitySubsystem, DeltaTime);
+		const double MoveTime = RunProcessor(MoveProcessor, *EntitySubsystem, DeltaTime);
+		const double RenderPrepTime = RunProcessor(RenderPrepProcessor, *EntitySubsystem, DeltaTime);
+		const double RenderTime = RunProcessor(RenderProcessor, *EntitySubsystem, DeltaTime);
+
+		if (FrameNdx < NumWarmupFrames)
+		{
+			continue;
+		}
+
+		const FBoidsRuleTimings& RuleTimings = RuleProcessor->GetLastTimings();
+
+		Frame.Samples.Add(RetireTime + SpawnTime + LODTime + RuleTime + BoundsTime + ObstacleTime + MoveTime + RenderPrepTime + RenderTime);
+		LOD.Samples.Add(LODTime);
+		Rules.Samples.Add(RuleTime);
+		GatherBoids.Samples.Add(RuleTimings.GatherBoids);
+		SetupBoidsGrid.Samples.Add(RuleTimings.SetupBoidsGrid);
+		RunBoidsRules.Samples.Add(RuleTimings.RunBoidsRules);
+		RunFlockField.Samples.Add(RuleTimings.RunFlockField);
+		ScatterBoids.Samples.Add(RuleTimings.ScatterBoids);
+		Bounds.Samples.Add(BoundsTime);
+		Obstacles.Samples.Add(ObstacleTime);
+		Move.Samples.Add(MoveTime);
+		RenderPrep.Samples.Add(RenderPrepTime);
+		Render.Samples.Add(RenderTime);
+
+		if (bWave)
+		{
+			RetireWave.Samples.Add(RetireTime);
+			SpawnWave.Samples.Add(SpawnTime);
+		}
+	}
+
+	if (ABoidsRenderActor* RenderActor = BoidsSubsystem->GetRenderActor())
+	{
+		const int32 NumRenderMismatches = VerifyRenderInstances(*RenderActor, *EntitySubsystem, bCompactPayload);
+		if (NumRenderMismatches > 0)
+		{
+			UE_LOG(LogBoidsBenchmark, Error, TEXT("%d render instances did not match their boid"), NumRenderMismatches);
+		}
+
+		NumMismatches += NumRenderMismatches;
+
+		// Dormant boids gave their instance back
+		int32 NumInstances = 0;
+		for (int32 MeshNdx = 0; MeshNdx < RenderActor->GetNumRenderMeshes(); MeshNdx++)
+		{
+			NumInstances += RenderActor->GetRenderMesh(MeshNdx).InstanceEntities.Num();
+		}
+
+		if (NumInstances != ActiveBoids.Num())
+		{
+			UE_LOG(LogBoidsBenchmark, Error, TEXT("%d render instances for %d active boids"), NumInstances, ActiveBoids.Num());
+			++NumMismatches;
+		}
+	}
+
+	// Keep the simulated flock, so that later runs can start from it without warming up
+	bool bSnapshotSaved = true;
+	if (!SaveSnapshotPath.IsEmpty())
+	{
+		// The benchmark spawns every boid from a single entity type, so does the snapshot
+		const FMassEntityTemplate* EntityTypeTemplates[] = { &EntityTemplate };
+		bSnapshotSaved = BoidsSubsystem->SaveSnapshot(SaveSnapshotPath, EntityTypeTemplates);
+	}
+
+	TArray<FBoidsBenchmarkStep*> Steps = { &Frame, &LOD, &Rules, &GatherBoids, &SetupBoidsGrid, &RunBoidsRules, &RunFlockField, &ScatterBoids, &Bounds, &Obstacles, &Move, &RenderPrep, &Render };
+	if (WaveSize > 0)
+	{
+		Steps.Add(&RetireWave);
+		Steps.Add(&SpawnWave);
+	}
+
+	// Write the results
+	FString Output;
+	const bool bJson = FPaths::GetExtension(OutputPath).Equals(TEXT("json"), ESearchCase::IgnoreCase);
+	if (bJson)
+	{
+		Output += FString::Printf(TEXT("{\n\t\"boids\": %d,\n\t\"frames\": %d,\n\t\"seed\": %d,\n\t\"steps\": [\n"), NumBoids, NumFrames, Seed);
+	}
+	else
+	{
+		Output += TEXT("Step,MeanMs,P50Ms,P99Ms\n");
+	}
+
+	for (int32 Ndx = 0; Ndx < Steps.Num(); Ndx++)
+	{
+		FBoidsBenchmarkStep& Step = *Steps[Ndx];
+		Step.Finish();
+
+		UE_LOG(LogBoidsBenchmark, Display, TEXT("%-16s mean %8.3f ms  p50 %8.3f ms  p99 %8.3f ms"), *Step.Name, Step.Mean, Step.P50, Step.P99);
+
+		if (bJson)
+		{
+			Output += FString::Printf(TEXT("\t\t{ \"name\": \"%s\", \"mean_ms\": %f, \"p50_ms\": %f, \"p99_ms\": %f }%s\n"), *Step.Name, Step.Mean, Step.P50, Step.P99, Ndx + 1 < Steps.Num() ? TEXT(",") : TEXT(""));
+		}
+		else
+		{
+			Output += FString::Printf(TEXT("%s,%f,%f,%f\n"), *Step.Name, Step.Mean, Step.P50, Step.P99);
+		}
+	}
+
+	if (bJson)
+	{
+		Output += TEXT("\t]\n}\n");
+	}
+
+	const bool bSaved = FFileHelper::SaveStringToFile(Output, *OutputPath);
+	if (bSaved)
+	{
+		UE_LOG(LogBoidsBenchmark, Display, TEXT("Wrote results to %s"), *FPaths::ConvertRelativePathToFull(OutputPath));
+	}
+	else
+	{
+		UE_LOG(LogBoidsBenchmark, Error, TEXT("Could not write results to %s"), *OutputPath);
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return bSaved && bSnapshotSaved && NumMismatches == 0 ? 0 : 1;
+}
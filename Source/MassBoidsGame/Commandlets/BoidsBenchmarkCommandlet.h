@@ -0,0 +1,40 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BoidsBenchmarkCommandlet.generated.h"
+
+/**
+ * Runs the boids processors headless for a fixed number of frames and writes the time spent in each of them.
+ *
+ * Usage: UnrealEditor-Cmd MassBoidsGame.uproject -run=BoidsBenchmark -nullrhi -unattended
+ *        [-Boids=100000] [-Frames=300] [-Warmup=30] [-Seed=0] [-DeltaTime=0.0166667]
+ *        [-Config=/Game/BP_BoidConfig.BP_BoidConfig] [-Output=Saved/Benchmarks/BoidsBenchmark.csv] [-CompactRender] [-SyntheticObstacles] [-FlockField]
+ *        [-LoadSnapshot=Saved/Boids/Flock.bsnp] [-SaveSnapshot=Saved/Boids/Flock.bsnp]
+ *        [-WaveSize=0] [-WaveInterval=30]
+ *
+ * The output is written as JSON when the output file ends with .json, and as CSV otherwise.
+ * -CompactRender sends the compact render payload instead of the transforms. After the last frame the render instances are
+ * checked against the boids, and the commandlet fails if any of them does not match.
+ * -SyntheticObstacles enables obstacle avoidance and avoids a sphere in the middle of the bounds instead of the obstacle field baked for the project.
+ * -FlockField enables the flock field whatever the settings are.
+ * -LoadSnapshot spawns every boid of a snapshot instead of random boids, and fails if they do not have the state they were saved with.
+ * -SaveSnapshot saves the boids after the last frame, so that later runs can start from an already simulated flock.
+ * -WaveSize retires that many of the oldest boids every WaveInterval frames and spawns them back at the next wave through the pool of the
+ * boids subsystem. The retire and spawn times are reported, and the commandlet fails if dormant boids moved or spawning did not reactivate them.
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UBoidsBenchmarkCommandlet(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UCommandlet interface
+	virtual int32 Main(const FString& Params) override;
+	// ~ end UCommandlet interface
+};
@@ -0,0 +1,35 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsTileMeshComponent.h"
+
+// Engine
+#include "Engine/StaticMesh.h"
+
+UBoidsTileMeshComponent::UBoidsTileMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+	, TileBounds(ForceInit)
+{
+}
+
+void UBoidsTileMeshComponent::SetTileBounds(const FBox& InTileBounds)
+{
+	TileBounds = InTileBounds;
+
+	UpdateBounds();
+	MarkRenderTransformDirty();
+}
+
+FBoxSphereBounds UBoidsTileMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (!TileBounds.IsValid || !GetStaticMesh())
+	{
+		return Super::CalcBounds(LocalToWorld);
+	}
+
+	// The mesh of a boid stays within its radius around the boid whatever its heading
+	const FBoxSphereBounds MeshBounds = GetStaticMesh()->GetBounds();
+	const float MeshRadius = MeshBounds.Origin.Size() + MeshBounds.SphereRadius;
+
+	return FBoxSphereBounds(TileBounds.ExpandBy(MeshRadius).TransformBy(GetComponentTransform().Inverse() * LocalToWorld));
+}
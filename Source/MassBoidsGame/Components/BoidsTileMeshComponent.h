@@ -0,0 +1,36 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "BoidsTileMeshComponent.generated.h"
+
+/**
+ * Instanced StaticMesh Component rendering the boids of one render tile. Its bounds are those of the tile rather than of its instances,
+ * so the tile is in view whenever its boids are, even while its instances were not updated
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsTileMeshComponent : public UInstancedStaticMeshComponent
+{
+	GENERATED_BODY()
+
+	/** Bounds every boid of the tile is in, in world space like the instance transforms */
+	FBox TileBounds;
+
+public:
+
+	UBoidsTileMeshComponent(const FObjectInitializer& ObjectInitializer);
+
+	/** Set the bounds the boids of the tile are in and update the bounds of the component, which reach as far as the mesh around them */
+	void SetTileBounds(const FBox& InTileBounds);
+
+	FORCEINLINE const FBox& GetTileBounds() const
+	{
+		return TileBounds;
+	}
+
+	// ~ begin USceneComponent interface
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	// ~ end USceneComponent interface
+};
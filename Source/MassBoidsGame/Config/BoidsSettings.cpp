@@ -3,18 +3,145 @@
 
 #include "BoidsSettings.h"
 
+// Engine
+#include "HAL/IConsoleManager.h"
+
+namespace
+{
+	/** Console variable bound to a setting, its name has to match the ConsoleVariable meta of the property */
+	struct FBoidsConsoleVariable
+	{
+		const TCHAR* Name;
+		const TCHAR* Help;
+		bool UBoidsSettings::* BoolProperty = nullptr;
+		int32 UBoidsSettings::* IntProperty = nullptr;
+		float UBoidsSettings::* FloatProperty = nullptr;
+
+		FBoidsConsoleVariable(const TCHAR* InName, bool UBoidsSettings::* InProperty, const TCHAR* InHelp)
+			: Name(InName), Help(InHelp), BoolProperty(InProperty)
+		{
+		}
+
+		FBoidsConsoleVariable(const TCHAR* InName, int32 UBoidsSettings::* InProperty, const TCHAR* InHelp)
+			: Name(InName), Help(InHelp), IntProperty(InProperty)
+		{
+		}
+
+		FBoidsConsoleVariable(const TCHAR* InName, float UBoidsSettings::* InProperty, const TCHAR* InHelp)
+			: Name(InName), Help(InHelp), FloatProperty(InProperty)
+		{
+		}
+	};
+
+	/** Every console variable of the settings, registered and unregistered from this table only */
+	const FBoidsConsoleVariable BoidsConsoleVariables[] =
+	{
+		{ TEXT("boids.FlockField"), &UBoidsSettings::bFlockField, TEXT("Steer boids with a coarse field of the density and velocity of the whole flock.") },
+		{ TEXT("boids.FlockCohesionRate"), &UBoidsSettings::FlockCohesionRate, TEXT("Rate at which boids turn towards denser parts of the flock.") },
+		{ TEXT("boids.FlockAlignment"), &UBoidsSettings::FlockAlignment, TEXT("Factor of matching the mean velocity of the flock around a boid, in [0, 1].") },
+		{ TEXT("boids.ObstacleAvoidance"), &UBoidsSettings::bObstacleAvoidance, TEXT("Steer boids away from the obstacles of the baked distance field.") },
+		{ TEXT("boids.IncrementalGrid"), &UBoidsSettings::bIncrementalGrid, TEXT("Update the boids grid from the previous frame instead of rebuilding it.") },
+		{ TEXT("boids.GridRebuildThreshold"), &UBoidsSettings::GridRebuildThreshold, TEXT("Fraction of boids that can change cells in a frame before the grid is rebuilt.") },
+		{ TEXT("boids.SpatialReordering"), &UBoidsSettings::bSpatialReordering, TEXT("Keep the boid data used by the rules in the grid order of the previous frame.") },
+		{ TEXT("boids.VectorizedRules"), &UBoidsSettings::bVectorizedRules, TEXT("Test four neighbors at a time using vector instructions when running the rules.") },
+		{ TEXT("boids.RuleUpdateBuckets"), &UBoidsSettings::RuleUpdateBuckets, TEXT("Number of frames over which the rules of every boid are updated.") },
+		{ TEXT("boids.SimulationLOD"), &UBoidsSettings::bSimulationLOD, TEXT("Lower the rule frequency of boids far from every viewer.") },
+		{ TEXT("boids.SkipHiddenRenderTiles"), &UBoidsSettings::bSkipHiddenRenderTiles, TEXT("Stop sending the instances of render tiles that were not rendered recently.") },
+		{ TEXT("boids.RenderTileUpdateDistance"), &UBoidsSettings::RenderTileUpdateDistance, TEXT("Distance to the closest viewer beyond which render tiles stop sending their instances, 0 for any distance.") }
+	};
+}
+
 UBoidsSettings::UBoidsSettings(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 	, Origin(FVector::ZeroVector)
-	, Alignment(0.5f)
-	, AlignmentDistanceSquared(500.f * 500.f)
-	, Separation(1.f)
-	, SeparationDistanceSquared(100.f * 100.f)
-	, Cohesion(0.5f)
-	, CohesionDistanceSquared(500.f * 500.f)
+	, bFlockField(false)
+	, FlockFieldNodesPerAxis(16)
+	, FlockCohesionRate(5.f)
+	, FlockAlignment(0.1f)
+	, FlockMinDensity(1.f)
+	, SpawnSeed(0)
 	, Extent(10000.f)
 	, TurnBackOffset(500.f)
 	, TurnBackRate(20.f)
-	, GridSize(2500.f)
+	, bObstacleAvoidance(false)
+	, ObstacleFieldFile(TEXT("Boids/Obstacles.bsdf"))
+	, ObstacleAvoidanceDistance(500.f)
+	, ObstacleAvoidanceRate(40.f)
+	, MaxGridCellsPerAxis(32)
+	, CellOrder(EBoidsCellOrder::Linear)
+	, bIncrementalGrid(true)
+	, GridRebuildThreshold(0.05f)
+	, bSpatialReordering(false)
+	, bVectorizedRules(true)
+	, RuleUpdateBuckets(1)
+	, bSimulationLOD(false)
+	, HighLODDistance(5000.f)
+	, MediumLODDistance(15000.f)
+	, LowLODDistance(30000.f)
+	, LODHysteresis(0.1f)
+	, MediumLODRuleBuckets(2)
+	, LowLODRuleBuckets(4)
+	, RenderPayload(EBoidsRenderPayload::Transform)
+	, RenderTilesPerAxis(4)
+	, bSkipHiddenRenderTiles(true)
+	, RenderTileUpdateDistance(0.f)
+{
+}
+
+void UBoidsSettings::PostInitProperties()
 {
+	Super::PostInitProperties();
+
+	// Processors read the default settings, so the console variables are bound to them
+	if (HasAnyFlags(RF_ClassDefaultObject))
+	{
+		RegisterConsoleVariables();
+	}
+}
+
+void UBoidsSettings::BeginDestroy()
+{
+	if (HasAnyFlags(RF_ClassDefaultObject))
+	{
+		UnregisterConsoleVariables();
+	}
+
+	Super::BeginDestroy();
+}
+
+void UBoidsSettings::RegisterConsoleVariables()
+{
+	IConsoleManager& ConsoleManager = IConsoleManager::Get();
+
+	// Variables left by a previous default object, such as after a hot reload, would still point at its properties
+	UnregisterConsoleVariables();
+
+	for (const FBoidsConsoleVariable& Variable : BoidsConsoleVariables)
+	{
+		if (Variable.BoolProperty)
+		{
+			ConsoleManager.RegisterConsoleVariableRef(Variable.Name, this->*Variable.BoolProperty, Variable.Help);
+		}
+		else if (Variable.IntProperty)
+		{
+			ConsoleManager.RegisterConsoleVariableRef(Variable.Name, this->*Variable.IntProperty, Variable.Help);
+		}
+		else
+		{
+			ConsoleManager.RegisterConsoleVariableRef(Variable.Name, this->*Variable.FloatProperty, Variable.Help);
+		}
+	}
+}
+
+void UBoidsSettings::UnregisterConsoleVariables()
+{
+	IConsoleManager& ConsoleManager = IConsoleManager::Get();
+
+	for (const FBoidsConsoleVariable& Variable : BoidsConsoleVariables)
+	{
+		if (IConsoleObject* ConsoleObject = ConsoleManager.FindConsoleObject(Variable.Name))
+		{
+			ConsoleManager.UnregisterConsoleObject(ConsoleObject, false);
+		}
+	}
 }
@@ -6,6 +6,35 @@
 #include "MassSettings.h"
 #include "BoidsSettings.generated.h"
 
+/**
+ * Order of the cells in the boids grid
+ */
+UENUM()
+enum class EBoidsCellOrder : uint8
+{
+	/** Cells are stored row by row, neighboring cells along X are next to each other in memory */
+	Linear,
+
+	/** Cells are stored along a Z-order curve, neighboring cells along every axis stay close in memory */
+	Morton
+};
+
+/**
+ * Data sent to the render components for every boid each frame
+ */
+UENUM()
+enum class EBoidsRenderPayload : uint8
+{
+	/** Full instance transform, works with any material */
+	Transform,
+
+	/**
+	 * Location and packed heading in four per-instance custom data floats, the material has to place and orient the mesh from them
+	 * and the pre-skinned local position. The instances of a tile share one transform that only carries the culling bounds of the tile
+	 */
+	Compact
+};
+
 /**
  * Global settings for the Boids system
  */
@@ -20,30 +49,30 @@ public:
 	UPROPERTY(Category="Bounds", Config, BlueprintReadWrite, EditAnywhere)
 	FVector Origin;
 
-	/** Alignment factor */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", ConsoleVariable="boids.Alignment"))
-	float Alignment;
-
-	/** Distance to find other boids for alignment */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.AlignmentDistanceSq"))
-	float AlignmentDistanceSquared;
+	/** Steer boids with a coarse field of the density and velocity of the whole flock, on top of the rules between neighbors */
+	UPROPERTY(Category="Flock Field", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.FlockField"))
+	bool bFlockField;
 
-	/** Separation factor */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", ConsoleVariable="boids.Separation"))
-	float Separation;
+	/** Number of nodes of the flock field along each axis of the bounds. Fewer nodes reach farther and are cheaper to build */
+	UPROPERTY(Category="Flock Field", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="2", ClampMax="64", EditCondition="bFlockField"))
+	int32 FlockFieldNodesPerAxis;
 
-	/** Distance to find other boids for separation */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.SeparationDistanceSq"))
-	float SeparationDistanceSquared;
+	/** Rate at which boids turn towards denser parts of the flock */
+	UPROPERTY(Category="Flock Field", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bFlockField", ConsoleVariable="boids.FlockCohesionRate"))
+	float FlockCohesionRate;
 
-	/** Cohesion factor */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", ConsoleVariable="boids.Cohesion"))
-	float Cohesion;
+	/** Factor of matching the mean velocity of the flock around a boid */
+	UPROPERTY(Category="Flock Field", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", EditCondition="bFlockField", ConsoleVariable="boids.FlockAlignment"))
+	float FlockAlignment;
 
-	/** Distance to find other boids for cohesion */
-	UPROPERTY(Category="Rules", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.CohesionDistanceSq"))
-	float CohesionDistanceSquared;
+	/** Smallest number of other boids around a boid for the flock field to steer it */
+	UPROPERTY(Category="Flock Field", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bFlockField"))
+	float FlockMinDensity;
 	
+	/** Seed of the random locations and rotations boids spawn with, the same seed always spawns the same flocks */
+	UPROPERTY(Category="Spawning", Config, BlueprintReadWrite, EditAnywhere)
+	int32 SpawnSeed;
+
 	/** World Size of the world for boids */
 	UPROPERTY(Category="Bounds", Config, BlueprintReadWrite, EditAnywhere)
 	float Extent;
@@ -56,9 +85,114 @@ public:
 	UPROPERTY(Category="Bounds", Config, BlueprintReadWrite, EditAnywhere)
 	float TurnBackRate;
 
-	/** The Sqrt size of each grid */
+	/** Steer boids away from the obstacles of the baked distance field. The field has to be baked for the project first with the BoidsBakeObstacles commandlet */
+	UPROPERTY(Category="Obstacles", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.ObstacleAvoidance"))
+	bool bObstacleAvoidance;
+
+	/** Distance field baked by the BoidsBakeObstacles commandlet, relative to the project content directory. Loaded when the world starts */
+	UPROPERTY(Category="Obstacles", Config, BlueprintReadWrite, EditAnywhere, Meta=(EditCondition="bObstacleAvoidance"))
+	FString ObstacleFieldFile;
+
+	/** Distance to an obstacle at which boids start turning away from it */
+	UPROPERTY(Category="Obstacles", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bObstacleAvoidance"))
+	float ObstacleAvoidanceDistance;
+
+	/** Rate at which to turn boids away from obstacles, grows as they get closer */
+	UPROPERTY(Category="Obstacles", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bObstacleAvoidance"))
+	float ObstacleAvoidanceRate;
+
+	/**
+	 * Maximum number of grid cells along each axis. Cells are sized by the largest rule distance and grow if more cells would be needed.
+	 * The grid clamps it to the most cells its layout can index, whatever the value is set to
+	 */
+	UPROPERTY(Category="Grid", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="1", ClampMax="64"))
+	int32 MaxGridCellsPerAxis;
+
+	/** Order of the cells in the grid, which is also the order boids are processed in by the rules */
 	UPROPERTY(Category="Grid", Config, BlueprintReadWrite, EditAnywhere)
-	float GridSize;
+	EBoidsCellOrder CellOrder;
+
+	/** Update the grid from the previous frame by only moving boids that changed cells, instead of rebuilding it */
+	UPROPERTY(Category="Grid", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.IncrementalGrid"))
+	bool bIncrementalGrid;
+
+	/** Fraction of boids that can change cells in a frame before the grid is rebuilt instead of updated */
+	UPROPERTY(Category="Grid", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", EditCondition="bIncrementalGrid", ConsoleVariable="boids.GridRebuildThreshold"))
+	float GridRebuildThreshold;
+
+	/** Keep the boid data used by the rules in the grid order of the previous frame, so that sorting it again is mostly sequential */
+	UPROPERTY(Category="Performance", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.SpatialReordering"))
+	bool bSpatialReordering;
+	
+	/** Test four neighbors at a time using vector instructions when running the rules */
+	UPROPERTY(Category="Performance", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.VectorizedRules"))
+	bool bVectorizedRules;
+
+	/** Number of frames over which the rules of every boid are updated. Each frame only one in this many boids runs the rules, the others keep their last steering */
+	UPROPERTY(Category="Performance", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="1", ClampMax="16", ConsoleVariable="boids.RuleUpdateBuckets"))
+	int32 RuleUpdateBuckets;
+
+	/** Lower the rule frequency of boids far from every viewer, and stop running the rules for the farthest ones */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.SimulationLOD"))
+	bool bSimulationLOD;
+
+	/** Distance to the closest viewer within which boids run the rules every frame */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bSimulationLOD"))
+	float HighLODDistance;
+
+	/** Distance to the closest viewer within which boids run the rules every MediumLODRuleBuckets frames */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bSimulationLOD"))
+	float MediumLODDistance;
+
+	/** Distance to the closest viewer within which boids run the rules every LowLODRuleBuckets frames. Boids beyond it only move and stay in bounds */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", EditCondition="bSimulationLOD"))
+	float LowLODDistance;
+
+	/** Fraction of a LOD distance a boid has to come closer before it switches back to the more detailed LOD */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0", EditCondition="bSimulationLOD"))
+	float LODHysteresis;
+
+	/** Number of frames over which the rules of medium LOD boids are updated, on top of RuleUpdateBuckets */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="1", ClampMax="16", EditCondition="bSimulationLOD"))
+	int32 MediumLODRuleBuckets;
+
+	/** Number of frames over which the rules of low LOD boids are updated, on top of RuleUpdateBuckets */
+	UPROPERTY(Category="LOD", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="1", ClampMax="16", EditCondition="bSimulationLOD"))
+	int32 LowLODRuleBuckets;
+
+	/** Data sent to the render components for every boid each frame */
+	UPROPERTY(Category="Rendering", Config, BlueprintReadWrite, EditAnywhere)
+	EBoidsRenderPayload RenderPayload;
+
+	/** Number of render tiles along each axis of the bounds. Each mesh gets a render component per tile, and boids move between them */
+	UPROPERTY(Category="Rendering", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="1", ClampMax="16"))
+	int32 RenderTilesPerAxis;
+
+	/**
+	 * Stop sending the transforms of tiles that were not rendered recently, until they are on screen again. The tile components are culled
+	 * with the bounds of their tile, so a tile is seen again as soon as any of its boids could be
+	 */
+	UPROPERTY(Category="Rendering", Config, BlueprintReadWrite, EditAnywhere, Meta=(ConsoleVariable="boids.SkipHiddenRenderTiles"))
+	bool bSkipHiddenRenderTiles;
+
+	/** Distance to the closest viewer beyond which tiles stop sending their transforms. Tiles are updated at any distance when zero */
+	UPROPERTY(Category="Rendering", Config, BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ConsoleVariable="boids.RenderTileUpdateDistance"))
+	float RenderTileUpdateDistance;
 	
 	UBoidsSettings(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UObject interface
+	virtual void PostInitProperties() override;
+	virtual void BeginDestroy() override;
+	// ~ end UObject interface
+
+private:
+
+	/**
+	 * Register the boids.* console variables, bound to the properties of the default settings that the processors read.
+	 * Setting one from the console changes the setting the next time it is read
+	 */
+	void RegisterConsoleVariables();
+
+	void UnregisterConsoleVariables();
 };
@@ -0,0 +1,67 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsSnapshotSpawnDataGenerator.h"
+#include "BoidsSnapshot.h"
+#include "Processors/BoidsSpawnProcessor.h"
+
+// Engine
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsSnapshotSpawn, Log, All);
+
+void UBoidsSnapshotSpawnDataGenerator::BuildSpawnData(const TSharedRef<const FBoidsSnapshot>& Snapshot, const int32 NumEntityTypes, TArray<FBoidsSnapshotSpawnData>& OutSpawnData)
+{
+	TArray<TArray<int32>> SpeciesBoids;
+	Snapshot->GetSpeciesBoids(SpeciesBoids);
+
+	if (SpeciesBoids.Num() > NumEntityTypes)
+	{
+		UE_LOG(LogBoidsSnapshotSpawn, Warning, TEXT("Snapshot has %d species for %d entity types, the boids of the other species are not spawned"), SpeciesBoids.Num(), NumEntityTypes);
+	}
+
+	OutSpawnData.Reset();
+	OutSpawnData.SetNum(NumEntityTypes);
+
+	for (int32 TypeNdx = 0; TypeNdx < FMath::Min(NumEntityTypes, SpeciesBoids.Num()); TypeNdx++)
+	{
+		OutSpawnData[TypeNdx].Snapshot = Snapshot;
+		OutSpawnData[TypeNdx].Boids = MoveTemp(SpeciesBoids[TypeNdx]);
+	}
+}
+
+void UBoidsSnapshotSpawnDataGenerator::Generate(UObject& QueryOwner, TConstArrayView<FMassSpawnedEntityType> EntityTypes, int32 Count, FFinishedGeneratingSpawnDataSignature& FinishedGeneratingSpawnPointsDelegate) const
+{
+	TArray<FMassEntitySpawnDataGeneratorResult> Results;
+
+	const FString FilePath = FPaths::Combine(FPaths::ProjectContentDir(), SnapshotFile);
+
+	const TSharedRef<FBoidsSnapshot> Snapshot = MakeShared<FBoidsSnapshot>();
+	if (!Snapshot->Open(*FilePath))
+	{
+		UE_LOG(LogBoidsSnapshotSpawn, Warning, TEXT("Failed to open the boids snapshot %s"), *FilePath);
+		FinishedGeneratingSpawnPointsDelegate.Execute(Results);
+		return;
+	}
+
+	TArray<FBoidsSnapshotSpawnData> SpawnData;
+	BuildSpawnData(Snapshot, EntityTypes.Num(), SpawnData);
+
+	// Every entity type is spawned in a single batch, the snapshot stays mapped until the spawn processor has read it
+	for (int32 TypeNdx = 0; TypeNdx < SpawnData.Num(); TypeNdx++)
+	{
+		if (SpawnData[TypeNdx].Boids.Num() == 0)
+		{
+			continue;
+		}
+
+		FMassEntitySpawnDataGeneratorResult& Result = Results.AddDefaulted_GetRef();
+		Result.EntityConfigIndex = TypeNdx;
+		Result.NumEntities = SpawnData[TypeNdx].Boids.Num();
+		Result.SpawnDataProcessor = UBoidsSpawnProcessor::StaticClass();
+		Result.SpawnData.InitializeAs<FBoidsSnapshotSpawnData>();
+		Result.SpawnData.GetMutable<FBoidsSnapshotSpawnData>() = MoveTemp(SpawnData[TypeNdx]);
+	}
+
+	FinishedGeneratingSpawnPointsDelegate.Execute(Results);
+}
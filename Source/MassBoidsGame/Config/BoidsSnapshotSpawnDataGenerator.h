@@ -0,0 +1,34 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassEntitySpawnDataGeneratorBase.h"
+#include "BoidsSnapshotSpawnDataGenerator.generated.h"
+
+class FBoidsSnapshot;
+struct FBoidsSnapshotSpawnData;
+
+/**
+ * Spawns the boids of a snapshot, so that a world starts from a flock that was already simulated instead of warming one up.
+ * Boids of species N are spawned from entity type N, so the snapshot has to be saved with the entity types of the spawner in the same order.
+ * The count of the spawner is ignored and every boid of the snapshot is spawned
+ */
+UCLASS(BlueprintType)
+class MASSBOIDSGAME_API UBoidsSnapshotSpawnDataGenerator : public UMassEntitySpawnDataGeneratorBase
+{
+	GENERATED_BODY()
+
+	/** Snapshot to spawn, relative to the content directory. Snapshots are saved with UBoidsSubsystem::SaveSnapshot */
+	UPROPERTY(Category="Boids", EditAnywhere)
+	FString SnapshotFile = TEXT("Boids/Flock.bsnp");
+
+public:
+
+	/** Split the boids of a snapshot into the spawn data of each entity type. Boids of species without an entity type are not spawned */
+	static void BuildSpawnData(const TSharedRef<const FBoidsSnapshot>& Snapshot, const int32 NumEntityTypes, TArray<FBoidsSnapshotSpawnData>& OutSpawnData);
+
+	// ~ begin UMassEntitySpawnDataGeneratorBase interface
+	virtual void Generate(UObject& QueryOwner, TConstArrayView<FMassSpawnedEntityType> EntityTypes, int32 Count, FFinishedGeneratingSpawnDataSignature& FinishedGeneratingSpawnPointsDelegate) const override;
+	// ~ end UMassEntitySpawnDataGeneratorBase interface
+};
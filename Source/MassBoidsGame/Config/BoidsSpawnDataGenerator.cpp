@@ -4,6 +4,37 @@
 #include "BoidsSpawnDataGenerator.h"
 #include "BoidsSettings.h"
 #include "Processors/BoidsSpawnProcessor.h"
+#include "Subsystems/BoidsSubsystem.h"
+
+// Engine
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "Math/RandomStream.h"
+
+namespace
+{
+	/** Number of transforms generated from the same random stream */
+	constexpr int32 SpawnBlockSize = 4096;
+}
+
+void UBoidsSpawnDataGenerator::GenerateTransforms(const FBox& Bounds, const int32 Seed, const int32 Num, TArray<FTransform>& OutTransforms)
+{
+	OutTransforms.SetNumUninitialized(Num);
+
+	const int32 NumBlocks = FMath::DivideAndRoundUp(Num, SpawnBlockSize);
+	ParallelFor(NumBlocks, [&Bounds, Seed, Num, &OutTransforms] (int32 BlockNdx)
+	{
+		FRandomStream RandomStream(HashCombine(GetTypeHash(Seed), GetTypeHash(BlockNdx)));
+
+		const int32 EndNdx = FMath::Min((BlockNdx + 1) * SpawnBlockSize, Num);
+		for (int32 Ndx = BlockNdx * SpawnBlockSize; Ndx < EndNdx; Ndx++)
+		{
+			const FRotator RandRot = FRotator(RandomStream.FRandRange(-180.f, 180.f), RandomStream.FRandRange(-180.f, 180.f), RandomStream.FRandRange(-180.f, 180.f));
+			const FVector RandPoint = FVector(RandomStream.FRandRange(Bounds.Min.X, Bounds.Max.X), RandomStream.FRandRange(Bounds.Min.Y, Bounds.Max.Y), RandomStream.FRandRange(Bounds.Min.Z, Bounds.Max.Z));
+			OutTransforms[Ndx] = FTransform(RandRot, RandPoint, FVector::ZeroVector);
+		}
+	});
+}
 
 void UBoidsSpawnDataGenerator::Generate(UObject& QueryOwner, TConstArrayView<FMassSpawnedEntityType> EntityTypes, int32 Count, FFinishedGeneratingSpawnDataSignature& FinishedGeneratingSpawnPointsDelegate) const
 {
@@ -13,22 +44,21 @@ void UBoidsSpawnDataGenerator::Generate(UObject& QueryOwner, TConstArrayView<FMa
 	const FVector MaxExtent = FVector((Settings->Extent / 2.f));
 	const FBox BoundingBox = FBox(MinExtent - Settings->TurnBackOffset, MaxExtent + Settings->TurnBackOffset);
 	
+	// Every spawn in a world gets its own seed, so repeated spawns differ but a run can be reproduced from the settings seed
+	UBoidsSubsystem* BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(QueryOwner.GetWorld());
+	const int32 SpawnSeed = BoidsSubsystem ? BoidsSubsystem->GetNextSpawnSeed() : Settings->SpawnSeed;
+
 	TArray<FMassEntitySpawnDataGeneratorResult> Results;
 	BuildResultsFromEntityTypes(Count, EntityTypes, Results);
 	
-	for (FMassEntitySpawnDataGeneratorResult& Result : Results)
+	for (int32 ResultNdx = 0; ResultNdx < Results.Num(); ResultNdx++)
 	{
+		FMassEntitySpawnDataGeneratorResult& Result = Results[ResultNdx];
 		Result.SpawnDataProcessor = UBoidsSpawnProcessor::StaticClass();
 		Result.SpawnData.InitializeAs<FMassTransformsSpawnData>();
 		FMassTransformsSpawnData& Transforms = Result.SpawnData.GetMutable<FMassTransformsSpawnData>();
-		Transforms.Transforms.Reserve(Result.NumEntities);
-		
-		for (int32 Ndx = 0; Ndx < Result.NumEntities; Ndx++)
-		{
-			const FRotator RandRot = FRotator(FMath::FRandRange(-180.f, 180.f),FMath::FRandRange(-180.f, 180.f), FMath::FRandRange(-180.f, 180.f));
-			const FVector RandPoint = FMath::RandPointInBox(BoundingBox);
-			Transforms.Transforms.Emplace(RandRot, RandPoint, FVector::ZeroVector);
-		}
+
+		GenerateTransforms(BoundingBox, HashCombine(GetTypeHash(SpawnSeed), GetTypeHash(ResultNdx)), Result.NumEntities, Transforms.Transforms);
 	}
 
 	FinishedGeneratingSpawnPointsDelegate.Execute(Results);
@@ -16,6 +16,12 @@ class MASSBOIDSGAME_API UBoidsSpawnDataGenerator : public UMassEntitySpawnDataGe
 
 public:
 
+	/**
+	 * Fill the transforms with random points inside the bounds and random rotations. The transforms are generated in parallel blocks,
+	 * each with its own random stream seeded from the seed and the block, so the same seed always gives the same transforms
+	 */
+	static void GenerateTransforms(const FBox& Bounds, const int32 Seed, const int32 Num, TArray<FTransform>& OutTransforms);
+
 	// ~ begin UMassEntitySpawnDataGeneratorBase interface
 	virtual void Generate(UObject& QueryOwner, TConstArrayView<FMassSpawnedEntityType> EntityTypes, int32 Count, FFinishedGeneratingSpawnDataSignature& FinishedGeneratingSpawnPointsDelegate) const override;
 	// ~ end UMassEntitySpawnDataGeneratorBase interface
@@ -3,7 +3,10 @@
 
 #include "BoidsTrait.h"
 #include "Fragments/BoidsLocationFragment.h"
-#include "Fragments/BoidsSpawnTag.h"
+#include "Fragments/BoidsLODFragment.h"
+#include "Fragments/BoidsRenderInstanceFragment.h"
+#include "Fragments/BoidsSteeringFragment.h"
+#include "Fragments/BoidsTurnBackFragment.h"
 
 // Engine
 #include "MassEntitySubsystem.h"
@@ -17,9 +20,12 @@ void UBoidsTrait::BuildTemplate(FMassEntityTemplateBuildContext& BuildContext, U
 	UMassEntitySubsystem* EntitySubsystem = UWorld::GetSubsystem<UMassEntitySubsystem>(&World);
 	check(EntitySubsystem);
 
-	BuildContext.AddTag<FBoidsSpawnTag>();
 	BuildContext.AddFragment<FBoidsLocationFragment>();
 	BuildContext.AddFragment<FMassVelocityFragment>();
+	BuildContext.AddFragment<FBoidsSteeringFragment>();
+	BuildContext.AddFragment<FBoidsTurnBackFragment>();
+	BuildContext.AddFragment<FBoidsLODFragment>();
+	BuildContext.AddFragment<FBoidsRenderInstanceFragment>();
 	BuildContext.AddFragment(FConstStructView::Make(Speed));
 
 	// Mesh Shared Fragment
@@ -28,4 +34,11 @@ void UBoidsTrait::BuildTemplate(FMassEntityTemplateBuildContext& BuildContext, U
 		const FConstSharedStruct SharedFragment = EntitySubsystem->GetOrCreateConstSharedFragment(SharedHash, Mesh);
 		BuildContext.AddConstSharedFragment(SharedFragment);
 	}
+
+	// Rules Shared Fragment, every config with the same rules flocks as the same species
+	{
+		const uint32 SharedHash = UE::StructUtils::GetStructCrc32(FConstStructView::Make(Rules));
+		const FConstSharedStruct SharedFragment = EntitySubsystem->GetOrCreateConstSharedFragment(SharedHash, Rules);
+		BuildContext.AddConstSharedFragment(SharedFragment);
+	}
 }
@@ -7,6 +7,7 @@
 
 
 #include "Fragments/BoidsMeshFragment.h"
+#include "Fragments/BoidsRulesFragment.h"
 #include "Fragments/BoidsSpeedFragment.h"
 
 #include "BoidsTrait.generated.h"
@@ -24,6 +25,9 @@ class MASSBOIDSGAME_API UBoidsTrait : public UMassEntityTraitBase
 
 	UPROPERTY(Category="Boids", EditAnywhere)
 	FBoidsMeshFragment Mesh;
+
+	UPROPERTY(Category="Boids", EditAnywhere)
+	FBoidsRulesFragment Rules;
 	
 	// ~ begin UMassEntityTraitBase interface
 	virtual void BuildTemplate(FMassEntityTemplateBuildContext& BuildContext, UWorld& World) const override;
@@ -0,0 +1,16 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "BoidsDormantTag.generated.h"
+
+/**
+ * Tag for Boids Entities that were retired to the pool. They are skipped by every boids processor and have no render instance
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsDormantTag : public FMassTag
+{
+	GENERATED_BODY()
+};
@@ -0,0 +1,25 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "MassLODTypes.h"
+#include "BoidsLODFragment.generated.h"
+
+/**
+ * Simulation LOD of a boid from its distance to the closest viewer. The rule processor picks how often the boid runs the rules from it
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsLODFragment : public FMassFragment
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TEnumAsByte<EMassLOD::Type> LOD;
+
+	FBoidsLODFragment()
+		: LOD(EMassLOD::High)
+	{
+	}
+};
@@ -0,0 +1,35 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "BoidsRenderInstanceFragment.generated.h"
+
+/**
+ * Instance of a boid in the render actor. Given when the boid spawns, replaced when it moves to another render tile and given back when it is destroyed
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsRenderInstanceFragment : public FMassFragment
+{
+	GENERATED_BODY()
+
+	/** Render mesh of the boid's mesh and tile in the render actor */
+	UPROPERTY()
+	int32 MeshIndex;
+
+	/** Instance of the boid in the render component of its mesh */
+	UPROPERTY()
+	int32 InstanceIndex;
+
+	/** Tile the boid moved to, set while it still has the instance of its previous tile */
+	UPROPERTY()
+	int32 NewTileIndex;
+
+	FBoidsRenderInstanceFragment()
+		: MeshIndex(INDEX_NONE)
+		, InstanceIndex(INDEX_NONE)
+		, NewTileIndex(INDEX_NONE)
+	{
+	}
+};
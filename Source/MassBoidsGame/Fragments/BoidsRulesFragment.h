@@ -0,0 +1,55 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "BoidsRulesFragment.generated.h"
+
+/**
+ * Rules of a species of boids. Boids with the same rules are the same species, whatever mesh they have
+ */
+USTRUCT(BlueprintType)
+struct MASSBOIDSGAME_API FBoidsRulesFragment : public FMassSharedFragment
+{
+	GENERATED_BODY()
+
+	/** Alignment factor */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0"))
+	float Alignment;
+
+	/** Distance to find other boids for alignment */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float AlignmentDistanceSquared;
+
+	/** Separation factor */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0"))
+	float Separation;
+
+	/** Distance to find other boids for separation */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float SeparationDistanceSquared;
+
+	/** Cohesion factor */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Meta=(ClampMin="0.0", ClampMax="1.0"))
+	float Cohesion;
+
+	/** Distance to find other boids for cohesion */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	float CohesionDistanceSquared;
+
+	/** Align and cohere with boids of other species too. Boids always keep their separation from every species */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	bool bFlockWithOtherSpecies;
+
+	FBoidsRulesFragment()
+		: Alignment(0.5f)
+		, AlignmentDistanceSquared(500.f * 500.f)
+		, Separation(1.f)
+		, SeparationDistanceSquared(100.f * 100.f)
+		, Cohesion(0.5f)
+		, CohesionDistanceSquared(500.f * 500.f)
+		, bFlockWithOtherSpecies(true)
+	{
+	}
+};
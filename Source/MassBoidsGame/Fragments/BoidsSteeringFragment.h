@@ -0,0 +1,25 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "BoidsSteeringFragment.generated.h"
+
+/**
+ * Steering from the boid rules. Written by the rules and applied to the velocity when moving, so that
+ * the rules always read the velocities of the previous frame
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsSteeringFragment : public FMassFragment
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector Value;
+
+	FBoidsSteeringFragment()
+		: Value(ForceInitToZero)
+	{
+	}
+};
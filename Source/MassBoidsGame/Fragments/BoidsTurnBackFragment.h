@@ -0,0 +1,24 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassCommonTypes.h"
+#include "BoidsTurnBackFragment.generated.h"
+
+/**
+ * Steering that turns boids back into the world bounds. Applied to the velocity when moving
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsTurnBackFragment : public FMassFragment
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector Value;
+
+	FBoidsTurnBackFragment()
+		: Value(ForceInitToZero)
+	{
+	}
+};
@@ -14,6 +14,6 @@ public class MassBoidsGame : ModuleRules
 				"MassBoidsGame"
 			});
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "BoidsCore" });
 	}
 }
@@ -3,19 +3,20 @@
 
 #include "BoidsBoundsProcessor.h"
 #include "BoidsTypes.h"
-#include "BoidsRenderProcessor.h"
-#include "BoidsRuleProcessor.h"
+#include "BoidsMovement.h"
+#include "BoidsMoveProcessor.h"
+#include "Fragments/BoidsDormantTag.h"
 #include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsTurnBackFragment.h"
 
 #include "MassCommonFragments.h"
-#include "MassMovementFragments.h"
 
 
 UBoidsBoundsProcessor::UBoidsBoundsProcessor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
-	ExecutionOrder.ExecuteAfter.Add(UBoidsRuleProcessor::StaticClass()->GetFName());
-	ExecutionOrder.ExecuteBefore.Add(UBoidsRenderProcessor::StaticClass()->GetFName());
+	// Only writes its own steering, so it can run at the same time as the rules
+	ExecutionOrder.ExecuteBefore.Add(UBoidsMoveProcessor::StaticClass()->GetFName());
 	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
 }
 
@@ -31,7 +32,8 @@ void UBoidsBoundsProcessor::ConfigureQueries()
 {
 	Entities
 		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
-		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All);
+		.AddRequirement<FBoidsTurnBackFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
 }
 
 void UBoidsBoundsProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
@@ -45,40 +47,14 @@ void UBoidsBoundsProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMass
 
 		const FBox BoundingBox = FBox(MinExtent - BoidsSettings->TurnBackOffset, MaxExtent + BoidsSettings->TurnBackOffset);
 		
-		const TArrayView<FMassVelocityFragment> Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>();
+		const TArrayView<FBoidsTurnBackFragment> TurnBacks = Context.GetMutableFragmentView<FBoidsTurnBackFragment>();
 		const TConstArrayView<FBoidsLocationFragment> Locations = Context.GetFragmentView<FBoidsLocationFragment>();
 
 		const int32 NumEntities = Context.GetNumEntities();
 		
 		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
 		{
-			const float& TurnRate = BoidsSettings->TurnBackRate;
-			const FVector& Location = Locations[Ndx].Location;
-			FVector& Velocity = Velocities[Ndx].Value;
-			
-			const bool bMinX = Location.X < BoundingBox.Min.X;
-			const bool bMinY = Location.Y < BoundingBox.Min.Y;
-			const bool bMinZ = Location.Z < BoundingBox.Min.Z;
-
-			// Turn back if outside minimum bounds
-			if (bMinX || bMinY || bMinZ)
-			{
-				Velocity.X += TurnRate * bMinX;
-				Velocity.Y += TurnRate * bMinY;
-				Velocity.Z += TurnRate * bMinZ;
-			}
-
-			const bool bMaxX = Location.X > BoundingBox.Max.X;
-			const bool bMaxY = Location.Y > BoundingBox.Max.Y;
-			const bool bMaxZ = Location.Z > BoundingBox.Max.Z;
-
-			// Turn back if outside maximum bounds
-			if (bMaxX || bMaxY || bMaxZ)
-			{
-				Velocity.X -= TurnRate * bMaxX;
-				Velocity.Y -= TurnRate * bMaxY;
-				Velocity.Z -= TurnRate * bMaxZ;
-			}
+			TurnBacks[Ndx].Value = BoidsCore::GetTurnBack(Locations[Ndx].Location, BoundingBox, BoidsSettings->TurnBackRate);
 		}
 	});
 }
@@ -0,0 +1,109 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsLODProcessor.h"
+#include "BoidsRuleProcessor.h"
+#include "Fragments/BoidsDormantTag.h"
+#include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsLODFragment.h"
+#include "Fragments/BoidsSteeringFragment.h"
+#include "BoidsTypes.h"
+
+// Engine
+#include "Engine/World.h"
+#include "MassLODSubsystem.h"
+#include "MassLODTypes.h"
+
+UBoidsLODProcessor::UBoidsLODProcessor(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
+	ExecutionOrder.ExecuteBefore.Add(UBoidsRuleProcessor::StaticClass()->GetFName());
+}
+
+void UBoidsLODProcessor::Initialize(UObject& Owner)
+{
+	Super::Initialize(Owner);
+
+	BoidsSettings = GetMutableDefault<UBoidsSettings>();
+	check(BoidsSettings);
+
+	LODSubsystem = UWorld::GetSubsystem<UMassLODSubsystem>(Owner.GetWorld());
+}
+
+void UBoidsLODProcessor::ConfigureQueries()
+{
+	Entities
+		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsLODFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsSteeringFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
+}
+
+void UBoidsLODProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsLODProcessor);
+
+	ViewerLocations.Reset();
+
+	if (BoidsSettings->bSimulationLOD && LODSubsystem)
+	{
+		for (const FViewerInfo& Viewer : LODSubsystem->GetViewers())
+		{
+			ViewerLocations.Add(Viewer.Location);
+		}
+	}
+
+	// Without viewers every boid is simulated at full detail
+	const bool bUseViewers = ViewerLocations.Num() > 0;
+
+	const float LODDistances[EMassLOD::Off] = { BoidsSettings->HighLODDistance, BoidsSettings->MediumLODDistance, BoidsSettings->LowLODDistance };
+	const float Hysteresis = FMath::Clamp(BoidsSettings->LODHysteresis, 0.f, 1.f);
+
+	// Pick the LOD of each boid from the closest viewer. The LOD only lives in the fragment, the rule processor reads it per boid
+	// so boids never change archetype when they change LOD
+	Entities.ParallelForEachEntityChunk(EntitySubsystem, Context, [this, bUseViewers, &LODDistances, Hysteresis] (FMassExecutionContext& Context)
+	{
+		const TConstArrayView<FBoidsLocationFragment> Locations = Context.GetFragmentView<FBoidsLocationFragment>();
+		const TArrayView<FBoidsLODFragment> LODs = Context.GetMutableFragmentView<FBoidsLODFragment>();
+		const TArrayView<FBoidsSteeringFragment> Steerings = Context.GetMutableFragmentView<FBoidsSteeringFragment>();
+
+		const int32 NumEntities = Context.GetNumEntities();
+		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+		{
+			EMassLOD::Type LOD = EMassLOD::High;
+
+			if (bUseViewers)
+			{
+				float ClosestDistanceSquared = MAX_flt;
+				for (const FVector& ViewerLocation : ViewerLocations)
+				{
+					ClosestDistanceSquared = FMath::Min(ClosestDistanceSquared, (float)FVector::DistSquared(Locations[Ndx].Location, ViewerLocation));
+				}
+
+				const float ClosestDistance = FMath::Sqrt(ClosestDistanceSquared);
+				const EMassLOD::Type PrevLOD = LODs[Ndx].LOD;
+
+				// Boids need to come closer than the distance of a LOD before they switch back to it, so they do not flicker between two LODs
+				LOD = EMassLOD::Off;
+				for (int32 LODNdx = EMassLOD::High; LODNdx < EMassLOD::Off; LODNdx++)
+				{
+					const float LODDistance = LODNdx < PrevLOD ? LODDistances[LODNdx] * (1.f - Hysteresis) : LODDistances[LODNdx];
+					if (ClosestDistance < LODDistance)
+					{
+						LOD = (EMassLOD::Type)LODNdx;
+						break;
+					}
+				}
+			}
+
+			LODs[Ndx].LOD = LOD;
+
+			// Boids that do not run the rules should not keep steering from when they did
+			if (LOD == EMassLOD::Off)
+			{
+				Steerings[Ndx].Value = FVector::ZeroVector;
+			}
+		}
+	});
+}
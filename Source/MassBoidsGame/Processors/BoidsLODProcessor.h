@@ -0,0 +1,43 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "Config/BoidsSettings.h"
+#include "BoidsLODProcessor.generated.h"
+
+class UMassLODSubsystem;
+
+/**
+ * Picks the simulation LOD of each boid from its distance to the closest viewer and stores it in its LOD fragment.
+ * Boids in the off LOD do not run the rules, they only move and stay in bounds
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsLODProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+public:
+
+	FMassEntityQuery Entities;
+
+	UPROPERTY(Transient)
+	UBoidsSettings* BoidsSettings;
+
+	UPROPERTY(Transient)
+	UMassLODSubsystem* LODSubsystem;
+
+	UBoidsLODProcessor(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UMassProcessor interface
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+	// ~ end UMassProcessor interface
+
+private:
+
+	/** Locations of the viewers this frame */
+	TArray<FVector> ViewerLocations;
+};
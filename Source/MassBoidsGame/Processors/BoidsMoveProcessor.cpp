@@ -3,17 +3,23 @@
 
 #include "BoidsMoveProcessor.h"
 #include "BoidsTypes.h"
+#include "BoidsMovement.h"
 
+#include "BoidsBoundsProcessor.h"
 #include "BoidsRuleProcessor.h"
 #include "MassMovementFragments.h"
+#include "Fragments/BoidsDormantTag.h"
 #include "Fragments/BoidsLocationFragment.h"
 #include "Fragments/BoidsSpeedFragment.h"
+#include "Fragments/BoidsSteeringFragment.h"
+#include "Fragments/BoidsTurnBackFragment.h"
 
 
 UBoidsMoveProcessor::UBoidsMoveProcessor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	ExecutionOrder.ExecuteAfter.Add(UBoidsRuleProcessor::StaticClass()->GetFName());
+	ExecutionOrder.ExecuteAfter.Add(UBoidsBoundsProcessor::StaticClass()->GetFName());
 	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
 }
 
@@ -22,7 +28,10 @@ void UBoidsMoveProcessor::ConfigureQueries()
 	Entities
 		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
 		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
-		.AddRequirement<FBoidsSpeedFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All);
+		.AddRequirement<FBoidsSpeedFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsSteeringFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsTurnBackFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
 }
 
 void UBoidsMoveProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
@@ -34,16 +43,15 @@ void UBoidsMoveProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassEx
 		const TArrayView<FBoidsLocationFragment>& Locations = Context.GetMutableFragmentView<FBoidsLocationFragment>();
 		const TArrayView<FMassVelocityFragment>& Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>();
 		const TConstArrayView<FBoidsSpeedFragment>& Speeds = Context.GetFragmentView<FBoidsSpeedFragment>();
+		const TConstArrayView<FBoidsSteeringFragment>& Steerings = Context.GetFragmentView<FBoidsSteeringFragment>();
+		const TConstArrayView<FBoidsTurnBackFragment>& TurnBacks = Context.GetFragmentView<FBoidsTurnBackFragment>();
 		
 		const float DeltaTime = Context.GetDeltaTimeSeconds();
 		const int32 NumEntities = Context.GetNumEntities();
 		
 		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
 		{
-			// Limit speed to MaxSpeed
-			Velocities[Ndx].Value = (Velocities[Ndx].Value / Velocities[Ndx].Value.Size()) * Speeds[Ndx].MaxSpeed;
-			// Update the location based on Velocity
-			Locations[Ndx].Location += Velocities[Ndx].Value * DeltaTime;
+			BoidsCore::MoveBoid(Locations[Ndx].Location, Velocities[Ndx].Value, Steerings[Ndx].Value + TurnBacks[Ndx].Value, Speeds[Ndx].MaxSpeed, DeltaTime);
 		}
 	});
 }
@@ -0,0 +1,71 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsObstacleProcessor.h"
+#include "BoidsTypes.h"
+#include "BoidsDistanceField.h"
+#include "BoidsBoundsProcessor.h"
+#include "BoidsMoveProcessor.h"
+#include "Config/BoidsSettings.h"
+#include "Fragments/BoidsDormantTag.h"
+#include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsTurnBackFragment.h"
+#include "Subsystems/BoidsSubsystem.h"
+
+#include "Engine/World.h"
+
+
+UBoidsObstacleProcessor::UBoidsObstacleProcessor(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	// Adds to the turn back steering, so it has to run once the bounds processor wrote it
+	ExecutionOrder.ExecuteAfter.Add(UBoidsBoundsProcessor::StaticClass()->GetFName());
+	ExecutionOrder.ExecuteBefore.Add(UBoidsMoveProcessor::StaticClass()->GetFName());
+	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
+}
+
+void UBoidsObstacleProcessor::Initialize(UObject& Owner)
+{
+	Super::Initialize(Owner);
+
+	BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(Owner.GetWorld());
+	check(BoidsSubsystem);
+
+	BoidsSettings = GetMutableDefault<UBoidsSettings>();
+	check(BoidsSettings);
+}
+
+void UBoidsObstacleProcessor::ConfigureQueries()
+{
+	Entities
+		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsTurnBackFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
+}
+
+void UBoidsObstacleProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsObstacleProcessor);
+
+	const FBoidsDistanceField& ObstacleField = BoidsSubsystem->GetObstacleField();
+	if (!BoidsSettings->bObstacleAvoidance || !ObstacleField.IsValid() || BoidsSettings->ObstacleAvoidanceDistance <= 0.f)
+	{
+		return;
+	}
+
+	Entities.ParallelForEachEntityChunk(EntitySubsystem, Context, [this, &ObstacleField] (FMassExecutionContext& Context)
+	{
+		const TArrayView<FBoidsTurnBackFragment> TurnBacks = Context.GetMutableFragmentView<FBoidsTurnBackFragment>();
+		const TConstArrayView<FBoidsLocationFragment> Locations = Context.GetFragmentView<FBoidsLocationFragment>();
+
+		const float AvoidDistance = BoidsSettings->ObstacleAvoidanceDistance;
+		const float AvoidRate = BoidsSettings->ObstacleAvoidanceRate;
+
+		const int32 NumEntities = Context.GetNumEntities();
+
+		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+		{
+			TurnBacks[Ndx].Value += BoidsCore::GetObstacleAvoidance(ObstacleField, Locations[Ndx].Location, AvoidDistance, AvoidRate);
+		}
+	});
+}
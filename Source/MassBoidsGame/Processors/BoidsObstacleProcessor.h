@@ -0,0 +1,38 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "BoidsObstacleProcessor.generated.h"
+
+class UBoidsSettings;
+class UBoidsSubsystem;
+
+/**
+ * Turns boids away from the obstacles of the world, using the distance field loaded by the boids subsystem.
+ * Adds to the turn back steering written by UBoidsBoundsProcessor
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsObstacleProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	FMassEntityQuery Entities;
+
+	UPROPERTY(Transient)
+	UBoidsSubsystem* BoidsSubsystem;
+
+	UPROPERTY(Transient)
+	UBoidsSettings* BoidsSettings;
+
+public:
+
+	UBoidsObstacleProcessor(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UMassProcessor interface
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+	// ~ end UMassProcessor interface
+};
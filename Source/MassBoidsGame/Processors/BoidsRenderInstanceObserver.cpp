@@ -0,0 +1,65 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsRenderInstanceObserver.h"
+#include "Fragments/BoidsRenderInstanceFragment.h"
+#include "Actors/BoidsRenderActor.h"
+#include "Subsystems/BoidsSubsystem.h"
+
+// Engine
+#include "MassEntitySubsystem.h"
+#include "Engine/World.h"
+
+UBoidsRenderInstanceObserver::UBoidsRenderInstanceObserver(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	ObservedType = FBoidsRenderInstanceFragment::StaticStruct();
+	Operation = EMassObservedOperation::Remove;
+	bRequiresGameThreadExecution = true;
+}
+
+void UBoidsRenderInstanceObserver::Initialize(UObject& Owner)
+{
+	Super::Initialize(Owner);
+
+	BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(Owner.GetWorld());
+	check(BoidsSubsystem);
+}
+
+void UBoidsRenderInstanceObserver::ConfigureQueries()
+{
+	Entities.AddRequirement<FBoidsRenderInstanceFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All);
+}
+
+void UBoidsRenderInstanceObserver::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	ABoidsRenderActor* RenderActor = BoidsSubsystem->GetRenderActor();
+	if (!RenderActor)
+	{
+		return;
+	}
+
+	Entities.ForEachEntityChunk(EntitySubsystem, Context, [RenderActor, &EntitySubsystem] (FMassExecutionContext& Context)
+	{
+		const TArrayView<FBoidsRenderInstanceFragment> Instances = Context.GetMutableFragmentView<FBoidsRenderInstanceFragment>();
+
+		const int32 NumEntities = Context.GetNumEntities();
+		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+		{
+			FBoidsRenderInstanceFragment& Instance = Instances[Ndx];
+			if (Instance.InstanceIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			// The last instance of the mesh took the place of this one
+			const FMassEntityHandle MovedEntity = RenderActor->RemoveInstance(Instance.MeshIndex, Instance.InstanceIndex);
+			if (MovedEntity.IsSet())
+			{
+				EntitySubsystem.GetFragmentDataChecked<FBoidsRenderInstanceFragment>(MovedEntity).InstanceIndex = Instance.InstanceIndex;
+			}
+
+			Instance.InstanceIndex = INDEX_NONE;
+		}
+	});
+}
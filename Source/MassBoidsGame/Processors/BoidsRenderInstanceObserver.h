@@ -0,0 +1,31 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassObserverProcessor.h"
+#include "BoidsRenderInstanceObserver.generated.h"
+
+class UBoidsSubsystem;
+
+/**
+ * Gives the render instance of destroyed boids back to the render actor
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsRenderInstanceObserver : public UMassObserverProcessor
+{
+	GENERATED_BODY()
+
+	FMassEntityQuery Entities;
+
+	UPROPERTY(Transient)
+	UBoidsSubsystem* BoidsSubsystem;
+
+	UBoidsRenderInstanceObserver(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UMassProcessor interface
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+	// ~ end UMassProcessor interface
+};
@@ -0,0 +1,114 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+
+#include "BoidsRenderPrepProcessor.h"
+#include "BoidsMoveProcessor.h"
+#include "Fragments/BoidsDormantTag.h"
+#include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsRenderInstanceFragment.h"
+#include "Actors/BoidsRenderActor.h"
+#include "Config/BoidsSettings.h"
+#include "Subsystems/BoidsSubsystem.h"
+#include "BoidsTypes.h"
+
+// Engine
+#include "MassMovementFragments.h"
+#include "Engine/World.h"
+
+UBoidsRenderPrepProcessor::UBoidsRenderPrepProcessor(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
+	ExecutionOrder.ExecuteAfter.Add(UBoidsMoveProcessor::StaticClass()->GetFName());
+}
+
+void UBoidsRenderPrepProcessor::Initialize(UObject& Owner)
+{
+	Super::Initialize(Owner);
+
+	BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(Owner.GetWorld());
+	check(BoidsSubsystem);
+
+	BoidsSettings = GetMutableDefault<UBoidsSettings>();
+	check(BoidsSettings);
+}
+
+void UBoidsRenderPrepProcessor::ConfigureQueries()
+{
+	Entities
+		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsRenderInstanceFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
+}
+
+void UBoidsRenderPrepProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsRenderPrepProcessor);
+
+	ABoidsRenderActor* RenderActor = BoidsSubsystem->GetRenderActor();
+	if (!RenderActor)
+	{
+		return;
+	}
+
+	const bool bCompactPayload = BoidsSettings->RenderPayload == EBoidsRenderPayload::Compact;
+
+	TAtomic<bool> bAnyMigrating(false);
+
+	// Every boid owns its instance, so chunks can write their transforms at the same time.
+	// Instances are only added and removed on the game thread, after this processor
+	Entities.ParallelForEachEntityChunk(EntitySubsystem, Context, [RenderActor, bCompactPayload, &bAnyMigrating] (FMassExecutionContext& Context)
+	{
+		const TArrayView<FBoidsRenderInstanceFragment> Instances = Context.GetMutableFragmentView<FBoidsRenderInstanceFragment>();
+		const TConstArrayView<FBoidsLocationFragment> Locations = Context.GetFragmentView<FBoidsLocationFragment>();
+		const TConstArrayView<FMassVelocityFragment> Velocities = Context.GetFragmentView<FMassVelocityFragment>();
+
+		bool bChunkMigrating = false;
+
+		const int32 NumEntities = Context.GetNumEntities();
+		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+		{
+			FBoidsRenderInstanceFragment& Instance = Instances[Ndx];
+			if (Instance.InstanceIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			FBoidsRenderMesh& RenderMesh = RenderActor->GetRenderMesh(Instance.MeshIndex);
+
+			// Boids outside of the bounds stay in the closest tile, which then grows to hold them. Either way the bounds of the tile
+			// component keep holding all of its boids, so hidden tiles are seen again as soon as any of their boids could be
+			if (!RenderMesh.TileBounds.IsInside(Locations[Ndx].Location))
+			{
+				Instance.NewTileIndex = RenderActor->GetTileIndex(Locations[Ndx].Location);
+				bChunkMigrating = true;
+			}
+
+			// Hidden tiles keep their last transforms, boids moving to another tile get theirs when they get their new instance
+			if (!RenderMesh.bUpdating)
+			{
+				continue;
+			}
+
+			if (bCompactPayload)
+			{
+				RenderMesh.SetInstanceCustomData(Instance.InstanceIndex, Locations[Ndx].Location, Velocities[Ndx].Value);
+			}
+			else
+			{
+				RenderMesh.SetInstanceTransform(Instance.InstanceIndex, Locations[Ndx].Location, Velocities[Ndx].Value);
+			}
+		}
+
+		if (bChunkMigrating)
+		{
+			bAnyMigrating = true;
+		}
+	});
+
+	if (bAnyMigrating)
+	{
+		RenderActor->SetHasPendingInstances();
+	}
+}
@@ -0,0 +1,37 @@
+﻿// Copyright Dennis Andersson. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MassProcessor.h"
+#include "BoidsRenderPrepProcessor.generated.h"
+
+class UBoidsSettings;
+class UBoidsSubsystem;
+
+/**
+ * Processor that writes the transform of each boid into its render instance on worker threads,
+ * so the render processor only has to hand the transforms to the render components.
+ * Also finds the boids that left their render tile, the render processor moves them to their new tile
+ */
+UCLASS()
+class MASSBOIDSGAME_API UBoidsRenderPrepProcessor : public UMassProcessor
+{
+	GENERATED_BODY()
+
+	FMassEntityQuery Entities;
+
+	UPROPERTY(Transient)
+	UBoidsSubsystem* BoidsSubsystem;
+
+	UPROPERTY(Transient)
+	UBoidsSettings* BoidsSettings;
+
+	UBoidsRenderPrepProcessor(const FObjectInitializer& ObjectInitializer);
+
+	// ~ begin UMassProcessor interface
+	virtual void Initialize(UObject& Owner) override;
+	virtual void ConfigureQueries() override;
+	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
+	// ~ end UMassProcessor interface
+};
@@ -2,26 +2,33 @@
 
 
 #include "BoidsRenderProcessor.h"
-#include "BoidsMoveProcessor.h"
+#include "BoidsRenderPrepProcessor.h"
+#include "Fragments/BoidsDormantTag.h"
 #include "Fragments/BoidsLocationFragment.h"
 #include "Fragments/BoidsMeshFragment.h"
-#include "Fragments/BoidsSpawnTag.h"
+#include "Fragments/BoidsRenderInstanceFragment.h"
 #include "Actors/BoidsRenderActor.h"
+#include "Config/BoidsSettings.h"
 #include "Subsystems/BoidsSubsystem.h"
 #include "BoidsTypes.h"
 
 // Engine
 #include "MassActorSubsystem.h"
+#include "MassLODSubsystem.h"
 #include "MassMovementFragments.h"
 #include "Components/InstancedStaticMeshComponent.h"
 #include "Engine/World.h"
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("Render Processor Allocations"), STAT_BoidsRenderProcessorAllocations, STATGROUP_Boids);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Render Tile Migrations"), STAT_BoidsRenderTileMigrations, STATGROUP_Boids);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Render Tiles Updated"), STAT_BoidsRenderTilesUpdated, STATGROUP_Boids);
+
 UBoidsRenderProcessor::UBoidsRenderProcessor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	bRequiresGameThreadExecution = true;
 	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
-	ExecutionOrder.ExecuteAfter.Add(UBoidsMoveProcessor::StaticClass()->GetFName());
+	ExecutionOrder.ExecuteAfter.Add(UBoidsRenderPrepProcessor::StaticClass()->GetFName());
 }
 
 void UBoidsRenderProcessor::Initialize(UObject& Owner)
@@ -30,6 +37,11 @@ void UBoidsRenderProcessor::Initialize(UObject& Owner)
 	
 	BoidsSubsystem = UWorld::GetSubsystem<UBoidsSubsystem>(Owner.GetWorld());
 	check(BoidsSubsystem);
+
+	BoidsSettings = GetMutableDefault<UBoidsSettings>();
+	check(BoidsSettings);
+
+	LODSubsystem = UWorld::GetSubsystem<UMassLODSubsystem>(Owner.GetWorld());
 }
 
 void UBoidsRenderProcessor::ConfigureQueries()
@@ -37,7 +49,8 @@ void UBoidsRenderProcessor::ConfigureQueries()
 	Entities
 		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
 		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
-		.AddTagRequirement<FBoidsSpawnTag>(EMassFragmentPresence::Optional)
+		.AddRequirement<FBoidsRenderInstanceFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None)
 		.AddConstSharedRequirement<FBoidsMeshFragment>(EMassFragmentPresence::All);
 }
 
@@ -48,74 +61,106 @@ void UBoidsRenderProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMass
 	ABoidsRenderActor* RenderActor = BoidsSubsystem->GetRenderActor();
 	if (RenderActor)
 	{
-		// Create render components for each mesh that boids can have
-		Entities.ForEachEntityChunk(EntitySubsystem, Context, [&RenderActor] (FMassExecutionContext& Context)
-		{
-			const FBoidsMeshFragment* SharedMesh = Context.GetConstSharedFragmentPtr<FBoidsMeshFragment>();
-			RenderActor->CreateNewRenderComponent(SharedMesh);
-		});
+		uint32 NumBufferAllocations = 0;
+		uint32 NumMigrations = 0;
 
-		TMap<const FBoidsMeshFragment*, TArray<FTransform>> BoidXForms;
-		TMap<const FBoidsMeshFragment*, TArray<FTransform>> NewBoidXForms;
+		const FVector HalfSize = FVector((BoidsSettings->Extent / 2.f) + BoidsSettings->TurnBackOffset);
+		RenderActor->SetupTiles(FBox(BoidsSettings->Origin - HalfSize, BoidsSettings->Origin + HalfSize), BoidsSettings->RenderTilesPerAxis);
 
-		// Get the transform for each entity
-		Entities.ForEachEntityChunk(EntitySubsystem, Context, [&BoidXForms, &NewBoidXForms] (FMassExecutionContext& Context)
+		// Give the boids that spawned an instance of their mesh in their tile, and move the boids that left their tile to an instance of the new one.
+		// All other boids keep their instance. The transforms of new instances were not prepared, so they are written here.
+		// With the compact payload the transform is the one shared by the instances of the tile
+		const bool bCompactPayload = BoidsSettings->RenderPayload == EBoidsRenderPayload::Compact;
+		if (RenderActor->ConsumePendingInstances())
 		{
-			const int32 NumEntities = Context.GetNumEntities();
-			const bool bNewlySpawned = Context.DoesArchetypeHaveTag<FBoidsSpawnTag>();
-
-			const FBoidsMeshFragment* SharedMesh = Context.GetConstSharedFragmentPtr<FBoidsMeshFragment>();
-
-			TArray<FTransform>& XForms = bNewlySpawned ? NewBoidXForms.FindOrAdd(SharedMesh) : BoidXForms.FindOrAdd(SharedMesh);
-			XForms.Reserve(XForms.Num() + NumEntities);
-		
-			const TConstArrayView<FBoidsLocationFragment>& Locations = Context.GetFragmentView<FBoidsLocationFragment>();
-			const TConstArrayView<FMassVelocityFragment>& Velocities = Context.GetFragmentView<FMassVelocityFragment>();
-
-			// Get Transform from all Entities
-			for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+			Entities.ForEachEntityChunk(EntitySubsystem, Context, [RenderActor, bCompactPayload, &EntitySubsystem, &NumBufferAllocations, &NumMigrations] (FMassExecutionContext& Context)
 			{
-				XForms.Add(FTransform
-				(
-					Velocities[Ndx].Value.Rotation() - FRotator(90.f, 0.f, 0.f),
-					Locations[Ndx].Location,
-					FVector::OneVector
-				));
-			}
-		});
+				const FBoidsMeshFragment* SharedMesh = Context.GetConstSharedFragmentPtr<FBoidsMeshFragment>();
+				if (!SharedMesh)
+				{
+					return;
+				}
+
+				const TArrayView<FBoidsRenderInstanceFragment> Instances = Context.GetMutableFragmentView<FBoidsRenderInstanceFragment>();
+				const TConstArrayView<FBoidsLocationFragment> Locations = Context.GetFragmentView<FBoidsLocationFragment>();
+				const TConstArrayView<FMassVelocityFragment> Velocities = Context.GetFragmentView<FMassVelocityFragment>();
+				const TConstArrayView<FMassEntityHandle> ChunkEntities = Context.GetEntities();
+
+				const int32 NumEntities = Context.GetNumEntities();
+				for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+				{
+					FBoidsRenderInstanceFragment& Instance = Instances[Ndx];
+
+					int32 TileIndex;
+					if (Instance.InstanceIndex == INDEX_NONE)
+					{
+						TileIndex = RenderActor->GetTileIndex(Locations[Ndx].Location);
+					}
+					else if (Instance.NewTileIndex != INDEX_NONE)
+					{
+						TileIndex = Instance.NewTileIndex;
+						Instance.NewTileIndex = INDEX_NONE;
+
+						// Boids past the bounds of all tiles have no other tile to go to, their tile grows instead
+						if (TileIndex == RenderActor->GetRenderMesh(Instance.MeshIndex).TileIndex)
+						{
+							RenderActor->GrowTileBounds(Instance.MeshIndex, Locations[Ndx].Location);
+							continue;
+						}
+
+						// The last instance of the previous tile took the place of this one
+						const FMassEntityHandle MovedEntity = RenderActor->RemoveInstance(Instance.MeshIndex, Instance.InstanceIndex);
+						if (MovedEntity.IsSet())
+						{
+							EntitySubsystem.GetFragmentDataChecked<FBoidsRenderInstanceFragment>(MovedEntity).InstanceIndex = Instance.InstanceIndex;
+						}
+
+						++NumMigrations;
+					}
+					else
+					{
+						continue;
+					}
+
+					const int32 MeshIndex = RenderActor->GetOrCreateRenderMesh(SharedMesh, TileIndex);
+
+					Instance.MeshIndex = MeshIndex;
+					Instance.InstanceIndex = RenderActor->AddInstance(MeshIndex, ChunkEntities[Ndx], NumBufferAllocations);
+
+					FBoidsRenderMesh& RenderMesh = RenderActor->GetRenderMesh(MeshIndex);
+					if (bCompactPayload)
+					{
+						RenderMesh.SetInstanceTileTransform(Instance.InstanceIndex);
+					}
+					else
+					{
+						RenderMesh.SetInstanceTransform(Instance.InstanceIndex, Locations[Ndx].Location, Velocities[Ndx].Value);
+					}
+					RenderMesh.SetInstanceCustomData(Instance.InstanceIndex, Locations[Ndx].Location, Velocities[Ndx].Value);
+				}
+			});
+		}
 
 		{
 			QUICK_SCOPE_CYCLE_COUNTER(STAT_UpdateRenderComponents);
-			
-			// Update existing instances
-			for (auto&& PairIt : BoidXForms)
-			{
-				UInstancedStaticMeshComponent* RenderComponent = RenderActor->GetRenderComponent(PairIt.Key);
-				check(RenderComponent);
-
-				RenderComponent->BatchUpdateInstancesTransforms
-				(
-					0,
-					PairIt.Value,
-					true,
-					true,
-					true
-				);
-			}
 
-			// Add new instances
-			for (auto&& PairIt : NewBoidXForms)
+			RenderActor->UpdateInstances(bCompactPayload, NumBufferAllocations);
+		}
+
+		// Pick the tiles that are prepared and sent next frame
+		ViewerLocations.Reset();
+		if (LODSubsystem && BoidsSettings->RenderTileUpdateDistance > 0.f)
+		{
+			for (const FViewerInfo& Viewer : LODSubsystem->GetViewers())
 			{
-				UInstancedStaticMeshComponent* RenderComponent = RenderActor->GetRenderComponent(PairIt.Key);
-				check(RenderComponent);
-
-				RenderComponent->AddInstances
-				(
-					PairIt.Value,
-					false,
-					true
-				);
+				ViewerLocations.Add(Viewer.Location);
 			}
 		}
+
+		const int32 NumTilesUpdated = RenderActor->UpdateTileVisibility(ViewerLocations, BoidsSettings->RenderTileUpdateDistance, BoidsSettings->bSkipHiddenRenderTiles);
+
+		INC_DWORD_STAT_BY(STAT_BoidsRenderProcessorAllocations, NumBufferAllocations);
+		INC_DWORD_STAT_BY(STAT_BoidsRenderTileMigrations, NumMigrations);
+		INC_DWORD_STAT_BY(STAT_BoidsRenderTilesUpdated, NumTilesUpdated);
 	}
 }
@@ -6,10 +6,13 @@
 #include "MassProcessor.h"
 #include "BoidsRenderProcessor.generated.h"
 
+class UBoidsSettings;
 class UBoidsSubsystem;
+class UMassLODSubsystem;
 
 /**
- * Processor for rendering boids
+ * Processor for rendering boids. Gives new boids a render instance, moves boids that changed render tiles to an instance of their new tile
+ * and hands the transforms prepared by UBoidsRenderPrepProcessor to the render components
  */
 UCLASS()
 class MASSBOIDSGAME_API UBoidsRenderProcessor : public UMassProcessor
@@ -21,6 +24,15 @@ class MASSBOIDSGAME_API UBoidsRenderProcessor : public UMassProcessor
 	UPROPERTY(Transient)
 	UBoidsSubsystem* BoidsSubsystem;
 
+	UPROPERTY(Transient)
+	UBoidsSettings* BoidsSettings;
+
+	UPROPERTY(Transient)
+	UMassLODSubsystem* LODSubsystem;
+
+	/** Locations of the viewers this frame */
+	TArray<FVector> ViewerLocations;
+
 	UBoidsRenderProcessor(const FObjectInitializer& ObjectInitializer);
 
 	// ~ begin UMassProcessor interface
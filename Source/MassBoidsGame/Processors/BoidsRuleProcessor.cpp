@@ -2,16 +2,27 @@
 
 
 #include "BoidsRuleProcessor.h"
+#include "Fragments/BoidsDormantTag.h"
 #include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsLODFragment.h"
+#include "Fragments/BoidsRulesFragment.h"
+#include "Fragments/BoidsSteeringFragment.h"
 #include "BoidsTypes.h"
+#include "BoidsRules.h"
 
 #include "MassCommonFragments.h"
 #include "MassMovementFragments.h"
+#include "MassLODTypes.h"
 #include "Async/ParallelFor.h"
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rule Processor Allocations"), STAT_BoidsRuleProcessorAllocations, STATGROUP_Boids);
 
 UBoidsRuleProcessor::UBoidsRuleProcessor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
+	, bReorderingBoids(false)
+	, bSlicingRules(false)
+	, RuleUpdateFrame(0)
+	, NumBufferAllocations(0)
 {
 	ExecutionOrder.ExecuteInGroup = MassBoidsGame::ProcessorGroupNames::Boids;
 }
@@ -19,241 +30,313 @@ UBoidsRuleProcessor::UBoidsRuleProcessor(const FObjectInitializer& ObjectInitial
 void UBoidsRuleProcessor::Initialize(UObject& Owner)
 {
 	Super::Initialize(Owner);
-	
+
 	BoidsSettings = GetMutableDefault<UBoidsSettings>();
 	check(BoidsSettings);
-
-	const int32 NumGridsSqrt = BoidsSettings->Extent / BoidsSettings->GridSize;
-	const int32 NumGrids = NumGridsSqrt * NumGridsSqrt;
-
-	BoidsPerGrid.AddDefaulted(NumGrids);
-	BoidsGrid.AddDefaulted(NumGrids);
 }
 
 void UBoidsRuleProcessor::ConfigureQueries()
 {
 	Entities
 		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
-		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All);
+		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsSteeringFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsLODFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddConstSharedRequirement<FBoidsRulesFragment>(EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
 }
 
 void UBoidsRuleProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsRuleProcessor);
 
-	TArray<const FVector*> AllLocations;
-	TArray<FVector*> AllVelocities;
+	int32 NumBoids = 0;
+	NumBufferAllocations = 0;
+
+	const int32 MaxChunkViews = ChunkViews.Max();
+	ChunkViews.Reset();
+
+	// Boids are put in buckets by entity index, which stays the same while the entity lives whichever chunk it is in, and the buckets are updated round-robin.
+	// Boids at a lower LOD are split in more buckets so they run the rules less often, off LOD boids stay in the grid as neighbors but never run them
+	const int32 NumRuleBuckets = FMath::Max(BoidsSettings->RuleUpdateBuckets, 1);
+	LODRuleBuckets[EMassLOD::High] = NumRuleBuckets;
+	LODRuleBuckets[EMassLOD::Medium] = NumRuleBuckets * FMath::Max(BoidsSettings->MediumLODRuleBuckets, 1);
+	LODRuleBuckets[EMassLOD::Low] = NumRuleBuckets * FMath::Max(BoidsSettings->LowLODRuleBuckets, 1);
+	LODRuleBuckets[EMassLOD::Off] = 0;
+	const uint32 RuleFrame = RuleUpdateFrame++;
+
+	bSlicingRules = NumRuleBuckets > 1 || BoidsSettings->bSimulationLOD;
 
-	// Get locations and velocities for all entities
-	Entities.ForEachEntityChunk(EntitySubsystem, Context, [&AllLocations, &AllVelocities] (FMassExecutionContext& Context)
+	SpeciesRules.Reset();
+
+	// Get the fragments of each chunk so that they can be copied in parallel
+	Entities.ForEachEntityChunk(EntitySubsystem, Context, [&] (FMassExecutionContext& Context)
 	{
-		const TConstArrayView<FBoidsLocationFragment>& Locations = Context.GetFragmentView<FBoidsLocationFragment>();
-		const TArrayView<FMassVelocityFragment>& Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>();
+		const int32 NumEntities = Context.GetNumEntities();
 
-		for (int32 Ndx = 0; Ndx < Context.GetNumEntities(); Ndx++)
+		// Boids are limited to as many species as fit in the species buffer, any more flock with the last one
+		const FBoidsRulesFragment* Rules = Context.GetConstSharedFragmentPtr<FBoidsRulesFragment>();
+		int32 Species = SpeciesRules.Find(Rules);
+		if (Species == INDEX_NONE)
 		{
-			AllLocations.Add(&Locations[Ndx].Location);
-			AllVelocities.Add(&Velocities[Ndx].Value);
+			Species = SpeciesRules.Num() <= MAX_uint8 ? SpeciesRules.Add(Rules) : MAX_uint8;
 		}
+
+		FBoidsChunkView& ChunkView = ChunkViews.AddDefaulted_GetRef();
+		ChunkView.Entities = Context.GetEntities().GetData();
+		ChunkView.Locations = Context.GetFragmentView<FBoidsLocationFragment>().GetData();
+		ChunkView.Velocities = Context.GetFragmentView<FMassVelocityFragment>().GetData();
+		ChunkView.Steerings = Context.GetMutableFragmentView<FBoidsSteeringFragment>().GetData();
+		ChunkView.LODs = Context.GetFragmentView<FBoidsLODFragment>().GetData();
+		ChunkView.NumEntities = NumEntities;
+		ChunkView.Offset = NumBoids;
+		ChunkView.Species = Species;
+
+		NumBoids += NumEntities;
 	});
 
-	// TODO: Make sure no other thread is writing to FMassVelocityFragment at the same time
-	// Ideally we should be able to pass in a boolean to ForEachEntityChunk to specify if we 
-	// want to ClearExecutionData so that we can do it manually. 
+	NumBufferAllocations += ChunkViews.Max() != MaxChunkViews;
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// The rules of each species are read once per frame instead of for every boid
+	SetupSpeciesRules();
+
+	// Copy locations and velocities of all entities into contiguous buffers
+	GatherBoids(NumBoids, RuleFrame);
 
-	const int32 NumBoids = AllVelocities.Num();
+	const double GatherEndTime = FPlatformTime::Seconds();
 
 	// Calculates the grid of each boid
-	SetupBoidsGrid(AllLocations, NumBoids);
+	SetupBoidsGrid();
+
+	const double GridEndTime = FPlatformTime::Seconds();
 
 	// Get all the rules for each boid
 	{
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidRules);
-		
-		RunBoidsAlignment(AllLocations, NumBoids);
-		RunBoidsSeparation(AllLocations, NumBoids);
-		RunBoidsCohesion(AllLocations, AllVelocities, NumBoids);
+
+		RunBoidsRules(NumBoids);
 	}
 
-	{
-		QUICK_SCOPE_CYCLE_COUNTER(STAT_ApplyBoidRules);
+	const double RulesEndTime = FPlatformTime::Seconds();
 
-		// Apply all of the rules to the boids
-		ParallelFor(NumBoids, [this, &AllVelocities] (int32 Ndx)
-		{
-			(*AllVelocities[Ndx]) += BoidAlignments[Ndx] + BoidSeparations[Ndx] + BoidCohesions[Ndx];
-		});
+	// Add the steering of the flock beyond the neighbors of each boid
+	if (BoidsSettings->bFlockField)
+	{
+		RunFlockField();
 	}
+
+	const double FlockFieldEndTime = FPlatformTime::Seconds();
+
+	// Write the steering of all rules back to the boids, it is applied to the velocity when moving
+	ScatterBoids();
+
+	const double ScatterEndTime = FPlatformTime::Seconds();
+
+	LastTimings.GatherBoids = GatherEndTime - StartTime;
+	LastTimings.SetupBoidsGrid = GridEndTime - GatherEndTime;
+	LastTimings.RunBoidsRules = RulesEndTime - GridEndTime;
+	LastTimings.RunFlockField = FlockFieldEndTime - RulesEndTime;
+	LastTimings.ScatterBoids = ScatterEndTime - FlockFieldEndTime;
+
+	INC_DWORD_STAT_BY(STAT_BoidsRuleProcessorAllocations, NumBufferAllocations);
 }
 
-void UBoidsRuleProcessor::SetupBoidsGrid(TArray<const FVector*>& BoidLocations, const int32 NumBoids)
+void UBoidsRuleProcessor::GatherBoids(const int32 NumBoids, const uint32 RuleFrame)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SetupBoidsGrid);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_GatherBoids);
+
+	BoidsCore::ResizeBuffer(BoidLocations, NumBoids, NumBufferAllocations);
+	BoidsCore::ResizeBuffer(BoidVelocities, NumBoids, NumBufferAllocations);
 
-	BoidsGridIndex.Init(INDEX_NONE, NumBoids);
-	
-	// Get the grid for each boid
-	ParallelFor(NumBoids, [this, &BoidLocations] (int32 Ndx)
+	bReorderingBoids = BoidsSettings->bSpatialReordering;
+	if (bReorderingBoids)
 	{
-		const int32 NumGridsSqrt = BoidsSettings->Extent / BoidsSettings->GridSize;
-
-		const float GridOriginX = ((BoidsSettings->GridSize * NumGridsSqrt) / 2) - BoidsSettings->Origin.X;
-		const float GridOriginY = ((BoidsSettings->GridSize * NumGridsSqrt) / 2) - BoidsSettings->Origin.Y;
-		
-		const int32 GridX = (int32)((*BoidLocations[Ndx]).X + GridOriginX) / BoidsSettings->GridSize;
-		const int32 GridY = (int32)((*BoidLocations[Ndx]).Y + GridOriginY) / BoidsSettings->GridSize;
-		
-		const bool bValidX = GridX >= 0 && GridX < NumGridsSqrt;
-		const bool bValidY = GridY >= 0 && GridY < NumGridsSqrt;
-		
-		if (bValidX && bValidY)
+		// Start over from the entity order when the boids changed since the last sort
+		if (BoidsSortedRank.Num() != NumBoids)
 		{
-			BoidsGridIndex[Ndx] = GridY * NumGridsSqrt + GridX;
+			BoidsCore::ResizeBuffer(BoidsSortedRank, NumBoids, NumBufferAllocations);
+			for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+			{
+				BoidsSortedRank[Ndx] = Ndx;
+			}
 		}
-	});
-
-	for (int32 Ndx = 0; Ndx < BoidsGrid.Num(); Ndx++)
+	}
+	else
 	{
-		BoidsGrid[Ndx].Empty(BoidsPerGrid[Ndx]);
+		BoidsSortedRank.Reset();
 	}
-	
-	for (int32 Ndx = 0; Ndx < NumBoids; Ndx++)
+
+	if (bSlicingRules)
 	{
-		const uint32 BoidGridIndex = BoidsGridIndex[Ndx];
-		if (BoidGridIndex != INDEX_NONE)
-		{
-			BoidsGrid[BoidGridIndex].Add(Ndx);
-		}
+		BoidsCore::ResizeBuffer(BoidsUpdatingRules, NumBoids, NumBufferAllocations);
 	}
-}
 
-void UBoidsRuleProcessor::RunBoidsAlignment(TArray<const FVector*>& BoidLocations, const int32 NumBoids)
-{
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_RunBoidsAlignment);
+	const bool bMultipleSpecies = SpeciesRules.Num() > 1;
+	if (bMultipleSpecies)
+	{
+		BoidsCore::ResizeBuffer(BoidsSpecies, NumBoids, NumBufferAllocations);
+	}
 
-	BoidAlignments.Init(FVector(), NumBoids);
-	
-	const float Alignment = FMath::Clamp(BoidsSettings->AlignmentDistanceSquared, 0.f, 1.0f) / 100.f;
-	
-	ParallelFor(NumBoids, [this, &BoidLocations, Alignment] (int32 Ndx)
+	ParallelFor(ChunkViews.Num(), [this, bMultipleSpecies, RuleFrame] (int32 ChunkNdx)
 	{
-		const int32 BoidGridNdx = BoidsGridIndex[Ndx];
-		if (BoidGridNdx != INDEX_NONE)
+		const FBoidsChunkView& ChunkView = ChunkViews[ChunkNdx];
+
+		for (int32 Ndx = 0; Ndx < ChunkView.NumEntities; Ndx++)
 		{
-			const TArray<int32>& NearbyBoids = BoidsGrid[BoidGridNdx];
+			const int32 BoidNdx = bReorderingBoids ? BoidsSortedRank[ChunkView.Offset + Ndx] : ChunkView.Offset + Ndx;
+
+			BoidLocations.Set(BoidNdx, ChunkView.Locations[Ndx].Location);
+			BoidVelocities.Set(BoidNdx, ChunkView.Velocities[Ndx].Value);
+
+			if (bSlicingRules)
+			{
+				const int32 NumBuckets = LODRuleBuckets[ChunkView.LODs[Ndx].LOD];
+				BoidsUpdatingRules[BoidNdx] = NumBuckets > 0 && (uint32)ChunkView.Entities[Ndx].Index % NumBuckets == RuleFrame % NumBuckets;
+			}
 
-			if (const int32 NumNearbyBoids = NearbyBoids.Num())
+			if (bMultipleSpecies)
 			{
-				// Local variable to avoid cache misses when doing iteration below
-				FVector BoidAlignment = BoidAlignments[Ndx];
-				const FVector BoidLocation = (*BoidLocations[Ndx]);
-
-				uint32 NumInRange = 0;
-				
-				for (int32 OtherNdx = 0; OtherNdx < NumNearbyBoids; OtherNdx++)
-				{
-					const int32 OtherBoidNdx = NearbyBoids[OtherNdx];
-					const FVector OtherBoidLocation = *BoidLocations[OtherBoidNdx];
-					
-					if (FVector::DistSquared(BoidLocation, OtherBoidLocation) < BoidsSettings->AlignmentDistanceSquared)
-					{
-						BoidAlignment += OtherBoidLocation;
-						++NumInRange;
-					}
-				}
-
-				if (NumInRange)
-				{
-					BoidAlignment /= NumInRange;
-					BoidAlignment = (BoidAlignment - BoidLocation) * Alignment;
-
-					BoidAlignments[Ndx] = BoidAlignment;
-				}
+				BoidsSpecies[BoidNdx] = (uint8)ChunkView.Species;
 			}
 		}
 	});
 }
 
-void UBoidsRuleProcessor::RunBoidsSeparation(TArray<const FVector*>& BoidLocations, const int32 NumBoids)
+void UBoidsRuleProcessor::ScatterBoids()
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_RunBoidsSeparation);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_ApplyBoidRules);
 
-	BoidSeparations.Init(FVector(), NumBoids);
-	
-	const float Separation = FMath::Clamp(BoidsSettings->Separation, 0.f, 1.0f) / 10.f;
-
-	ParallelFor(NumBoids, [this, &BoidLocations, Separation] (int32 Ndx)
+	ParallelFor(ChunkViews.Num(), [this] (int32 ChunkNdx)
 	{
-		const int32 BoidGridNdx = BoidsGridIndex[Ndx];
-		if (BoidGridNdx != INDEX_NONE)
+		const FBoidsChunkView& ChunkView = ChunkViews[ChunkNdx];
+
+		for (int32 Ndx = 0; Ndx < ChunkView.NumEntities; Ndx++)
 		{
-			const TArray<int32>& NearbyBoids = BoidsGrid[BoidGridNdx];
+			const int32 BoidNdx = bReorderingBoids ? BoidsSortedRank[ChunkView.Offset + Ndx] : ChunkView.Offset + Ndx;
+
+			// Boids outside of the bucket updated this frame keep their last steering
+			if (!bSlicingRules || BoidsUpdatingRules[BoidNdx])
+			{
+				ChunkView.Steerings[Ndx].Value = BoidSteerings[BoidNdx];
+			}
 
-			if (NearbyBoids.Num())
+			// Gather this boid in its current grid order next frame
+			if (bReorderingBoids)
 			{
-				// Local variable to avoid cache misses when doing iteration below
-				FVector BoidSeparation = BoidSeparations[Ndx];
-				const FVector BoidLocation = *BoidLocations[Ndx];
-			
-				for (int32 OtherNdx = 0; OtherNdx < NearbyBoids.Num(); OtherNdx++)
-				{
-					const int32 OtherBoidNdx = NearbyBoids[OtherNdx];
-					const FVector OtherBoidLocation = *BoidLocations[OtherBoidNdx];
-				
-					if (OtherBoidNdx != Ndx && FVector::DistSquared(BoidLocation, OtherBoidLocation) < BoidsSettings->SeparationDistanceSquared)
-					{
-						BoidSeparation += BoidLocation - OtherBoidLocation;
-					}
-				}
-
-				BoidSeparations[Ndx] = BoidSeparation * Separation;
+				BoidsSortedRank[ChunkView.Offset + Ndx] = BoidsGrid.GetBoidsGridSlot()[BoidNdx];
 			}
 		}
 	});
 }
 
-void UBoidsRuleProcessor::RunBoidsCohesion(TArray<const FVector*>& BoidLocations, TArray<FVector*>& BoidVelocities, const int32 NumBoids)
+void UBoidsRuleProcessor::SetupBoidsGrid()
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_RunBoidsCohesion);
+	// Cells must be at least as large as the largest rule distance of every species so that the surrounding cells contain every boid in range
+	float MaxDistanceSquared = 0.f;
+	for (const FBoidsRuleSettings& RuleSettings : SpeciesRuleSettings)
+	{
+		MaxDistanceSquared = FMath::Max(MaxDistanceSquared, FMath::Max3(RuleSettings.AlignmentDistanceSquared, RuleSettings.SeparationDistanceSquared, RuleSettings.CohesionDistanceSquared));
+	}
+
+	FBoidsGridSettings GridSettings;
+	GridSettings.Origin = FVector3f(BoidsSettings->Origin);
+	GridSettings.HalfSize = (BoidsSettings->Extent / 2.f) + BoidsSettings->TurnBackOffset;
+	GridSettings.MaxDistance = FMath::Sqrt(MaxDistanceSquared);
+	GridSettings.MaxCellsPerAxis = BoidsSettings->MaxGridCellsPerAxis;
+	GridSettings.bMortonOrder = BoidsSettings->CellOrder == EBoidsCellOrder::Morton;
+	GridSettings.bIncremental = BoidsSettings->bIncrementalGrid;
+	GridSettings.RebuildThreshold = BoidsSettings->GridRebuildThreshold;
 
-	BoidCohesions.Init(FVector(), NumBoids);
+	BoidsGrid.Setup(BoidLocations, BoidVelocities, GridSettings, bReorderingBoids);
 
-	const float Cohesion = FMath::Clamp(BoidsSettings->Cohesion, 0.f, 1.0f) / 10.f;
+	NumBufferAllocations += BoidsGrid.GetNumBufferAllocations();
+}
+
+void UBoidsRuleProcessor::RunBoidsRules(const int32 NumBoids)
+{
+	BoidsCore::ResizeBuffer(BoidSteerings, NumBoids, NumBufferAllocations);
 
-	ParallelFor(NumBoids, [this, &BoidLocations, &BoidVelocities, Cohesion] (int32 Ndx)
+	if (NumBoids == 0)
 	{
-		const int32 BoidGridNdx = BoidsGridIndex[Ndx];
-		if (BoidGridNdx != INDEX_NONE)
-		{
-			const TArray<int32>& NearbyBoids = BoidsGrid[BoidGridNdx];
+		return;
+	}
 
-			if (const int32 NumNearbyBoids = NearbyBoids.Num())
-			{
-				// Local variable to avoid cache misses when doing iteration below
-				FVector BoidCohesion = BoidCohesions[Ndx];
-				const FVector BoidLocation = *BoidLocations[Ndx];
-				const FVector BoidVelocity = *BoidVelocities[Ndx];
-
-				uint32 NumInRange = 0;
-			
-				for (int32 OtherNdx = 0; OtherNdx < NumNearbyBoids; OtherNdx++)
-				{
-					const int32 OtherBoidNdx = NearbyBoids[OtherNdx];
-					if (OtherBoidNdx != Ndx && FVector::DistSquared(BoidLocation, (*BoidLocations[OtherBoidNdx])) < BoidsSettings->CohesionDistanceSquared)
-					{
-						BoidCohesion += *BoidVelocities[OtherBoidNdx];
-						++NumInRange;
-					}
-				}
-
-				if (NumInRange)
-				{
-					BoidCohesion /= NumInRange;
-					BoidCohesion = (BoidCohesion - BoidVelocity) * Cohesion;
-
-					BoidCohesions[Ndx] = BoidCohesion;
-				}
-			}
-		}
-	});
-}
\ No newline at end of file
+	// Each boid runs the rules of its species, which needs their species in the order the grid runs them
+	if (SpeciesRuleSettings.Num() > 1)
+	{
+		BoidsCore::ResizeBuffer(SortedBoidsSpecies, NumBoids, NumBufferAllocations);
+		BoidsCore::SortBoidsSpecies(BoidsGrid, BoidsSpecies, SortedBoidsSpecies);
+	}
+	else
+	{
+		SortedBoidsSpecies.Reset();
+	}
+
+	if (!bSlicingRules)
+	{
+		BoidsCore::RunBoidsRules(BoidsGrid, SpeciesRuleSettings, SortedBoidsSpecies, BoidSteerings, TConstArrayView<int32>());
+		return;
+	}
+
+	// Only run the boids of this frame's bucket, still in grid order
+	const TArray<int32>& GridBoids = BoidsGrid.GetGridBoids();
+
+	BoidsCore::ResizeBuffer(SortedBoidsToUpdate, NumBoids, NumBufferAllocations);
+
+	int32 NumBoidsToUpdate = 0;
+	for (int32 SortedNdx = 0; SortedNdx < NumBoids; SortedNdx++)
+	{
+		SortedBoidsToUpdate[NumBoidsToUpdate] = SortedNdx;
+		NumBoidsToUpdate += BoidsUpdatingRules[GridBoids[SortedNdx]];
+	}
+
+	SortedBoidsToUpdate.SetNum(NumBoidsToUpdate, false);
+
+	if (NumBoidsToUpdate > 0)
+	{
+		BoidsCore::RunBoidsRules(BoidsGrid, SpeciesRuleSettings, SortedBoidsSpecies, BoidSteerings, SortedBoidsToUpdate);
+	}
+}
+
+void UBoidsRuleProcessor::SetupSpeciesRules()
+{
+	SpeciesRuleSettings.Reset();
+
+	for (const FBoidsRulesFragment* Rules : SpeciesRules)
+	{
+		FBoidsRuleSettings& RuleSettings = SpeciesRuleSettings.AddDefaulted_GetRef();
+		RuleSettings.Alignment = FMath::Clamp(Rules->Alignment, 0.f, 1.0f) / 10.f;
+		RuleSettings.Separation = FMath::Clamp(Rules->Separation, 0.f, 1.0f) / 10.f;
+		RuleSettings.Cohesion = FMath::Clamp(Rules->Cohesion, 0.f, 1.0f) / 10.f;
+		RuleSettings.AlignmentDistanceSquared = Rules->AlignmentDistanceSquared;
+		RuleSettings.SeparationDistanceSquared = Rules->SeparationDistanceSquared;
+		RuleSettings.CohesionDistanceSquared = Rules->CohesionDistanceSquared;
+		RuleSettings.bVectorized = BoidsSettings->bVectorizedRules;
+		RuleSettings.bFlockWithOtherSpecies = Rules->bFlockWithOtherSpecies;
+	}
+}
+
+void UBoidsRuleProcessor::RunFlockField()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsFlockField);
+
+	// Same bounds as the boids grid
+	FBoidsFlockFieldSettings FieldSettings;
+	FieldSettings.Origin = FVector3f(BoidsSettings->Origin);
+	FieldSettings.HalfSize = (BoidsSettings->Extent / 2.f) + BoidsSettings->TurnBackOffset;
+	FieldSettings.NodesPerAxis = BoidsSettings->FlockFieldNodesPerAxis;
+
+	FlockField.Build(BoidLocations, BoidVelocities, FieldSettings);
+
+	NumBufferAllocations += FlockField.GetNumBufferAllocations();
+
+	FBoidsFlockRuleSettings FlockRuleSettings;
+	FlockRuleSettings.Cohesion = FMath::Max(BoidsSettings->FlockCohesionRate, 0.f);
+	FlockRuleSettings.Alignment = FMath::Clamp(BoidsSettings->FlockAlignment, 0.f, 1.0f) / 10.f;
+	FlockRuleSettings.MinDensity = BoidsSettings->FlockMinDensity;
+
+	// Boids that did not run the rules this frame keep their last steering, whatever is added to theirs here is never scattered
+	BoidsCore::AddFlockSteering(FlockField, BoidLocations, BoidVelocities, FlockRuleSettings, BoidSteerings);
+}
@@ -4,11 +4,51 @@
 
 #include "CoreMinimal.h"
 #include "MassProcessor.h"
+#include "MassLODTypes.h"
 #include "Config/BoidsSettings.h"
+#include "BoidsTypes.h"
+#include "BoidsFlockField.h"
+#include "BoidsGrid.h"
+#include "BoidsRules.h"
 #include "BoidsRuleProcessor.generated.h"
 
+struct FBoidsLocationFragment;
+struct FBoidsLODFragment;
+struct FBoidsRulesFragment;
+struct FBoidsSteeringFragment;
+struct FMassVelocityFragment;
+
+/**
+ * View of the fragments in a single chunk and where they go in the contiguous boid buffers
+ */
+struct FBoidsChunkView
+{
+	const FMassEntityHandle* Entities;
+	const FBoidsLocationFragment* Locations;
+	const FMassVelocityFragment* Velocities;
+	FBoidsSteeringFragment* Steerings;
+	const FBoidsLODFragment* LODs;
+	int32 NumEntities;
+	int32 Offset;
+
+	/** Species of the boids of the chunk, which all share the same rules */
+	int32 Species;
+};
+
 /**
- * Processor that apply the rules of boids
+ * Time spent in each step of the rule processor during the last frame, in seconds
+ */
+struct FBoidsRuleTimings
+{
+	double GatherBoids = 0.0;
+	double SetupBoidsGrid = 0.0;
+	double RunBoidsRules = 0.0;
+	double RunFlockField = 0.0;
+	double ScatterBoids = 0.0;
+};
+
+/**
+ * Processor that apply the rules of boids. Copies the boids out of their chunks and runs the grid and rules of BoidsCore on them
  */
 UCLASS()
 class MASSBOIDSGAME_API UBoidsRuleProcessor : public UMassProcessor
@@ -20,13 +60,57 @@ class MASSBOIDSGAME_API UBoidsRuleProcessor : public UMassProcessor
 	UPROPERTY(Transient)
 	UBoidsSettings* BoidsSettings;
 	
-	TArray<FVector> BoidAlignments;
-	TArray<FVector> BoidSeparations;
-	TArray<FVector> BoidCohesions;
+	/** Fragment views of all chunks processed this frame */
+	TArray<FBoidsChunkView> ChunkViews;
+
+	/** Contiguous copy of all boid locations and velocities, reused every frame */
+	FBoidsVectorSoA BoidLocations;
+	FBoidsVectorSoA BoidVelocities;
+
+	/** Where each entity is copied to in the boid buffers when spatial reordering is enabled, which is its grid order of the previous frame */
+	TArray<int32> BoidsSortedRank;
+
+	/** If the boid buffers are in the order of BoidsSortedRank this frame */
+	bool bReorderingBoids;
 
-	TArray<TArray<int32>> BoidsGrid;
-	TArray<int32> BoidsGridIndex;
-	TArray<int32> BoidsPerGrid;
+	/** Rules of each species processed this frame, a species is any set of rules shared by some boids */
+	TArray<const FBoidsRulesFragment*> SpeciesRules;
+
+	/** Rules of each species, converted to the settings of BoidsCore once per frame */
+	TArray<FBoidsRuleSettings> SpeciesRuleSettings;
+
+	/** Species of each boid, in boid order and in the sorted order of the grid. Only filled when there are several species */
+	TArray<uint8> BoidsSpecies;
+	FBoidsFloatBuffer SortedBoidsSpecies;
+
+	/** Combined steering of all rules for each boid */
+	TArray<FVector> BoidSteerings;
+
+	/** If only some of the boids run the rules this frame */
+	bool bSlicingRules;
+
+	/** Incremented every frame to pick the buckets to update */
+	uint32 RuleUpdateFrame;
+
+	/** Number of buckets the boids of each LOD are split in for the rules this frame, zero for the LOD that does not run them */
+	int32 LODRuleBuckets[EMassLOD::Max];
+
+	/** If each boid is in the bucket updated this frame */
+	TArray<bool> BoidsUpdatingRules;
+
+	/** Sorted positions in the grid of the boids that are updated this frame */
+	TArray<int32> SortedBoidsToUpdate;
+
+	/** Grid of the boids, kept between frames so that it can be updated instead of rebuilt */
+	FBoidsGrid BoidsGrid;
+
+	/** Density and velocity of the whole flock, rebuilt every frame when enabled */
+	FBoidsFlockField FlockField;
+
+	/** Number of times a buffer had to grow this frame */
+	uint32 NumBufferAllocations;
+
+	FBoidsRuleTimings LastTimings;
 
 	UBoidsRuleProcessor(const FObjectInitializer& ObjectInitializer);
 
@@ -36,8 +120,20 @@ class MASSBOIDSGAME_API UBoidsRuleProcessor : public UMassProcessor
 	virtual void Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context) override;
 	// ~ end UMassProcessor interface
 
-	void SetupBoidsGrid(TArray<const FVector*>& BoidLocations, const int32 NumBoids);
-	void RunBoidsAlignment(TArray<const FVector*>& BoidLocations, const int32 NumBoids);
-	void RunBoidsSeparation(TArray<const FVector*>& BoidLocations, const int32 NumBoids);
-	void RunBoidsCohesion(TArray<const FVector*>& BoidLocations, TArray<FVector*>& BoidVelocities, const int32 NumBoids);
+public:
+
+	/** Get how long each step of the rules took during the last frame */
+	FORCEINLINE const FBoidsRuleTimings& GetLastTimings() const
+	{
+		return LastTimings;
+	}
+
+private:
+
+	void GatherBoids(const int32 NumBoids, const uint32 RuleFrame);
+	void ScatterBoids();
+	void SetupBoidsGrid();
+	void SetupSpeciesRules();
+	void RunBoidsRules(const int32 NumBoids);
+	void RunFlockField();
 };
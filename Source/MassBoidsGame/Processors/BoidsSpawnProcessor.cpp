@@ -3,17 +3,30 @@
 
 #include "BoidsSpawnProcessor.h"
 #include "BoidsRuleProcessor.h"
+#include "BoidsSnapshot.h"
 #include "MassMovementFragments.h"
 #include "Fragments/BoidsLocationFragment.h"
-#include "Fragments/BoidsSpawnTag.h"
 #include "Fragments/BoidsSpeedFragment.h"
 #include "Subsystems/BoidsSubsystem.h"
 #include "BoidsTypes.h"
 
 // Engine
+#include "Async/ParallelFor.h"
 #include "Engine/World.h"
 #include "MassSpawnerTypes.h"
 
+namespace
+{
+	/** Fragments of a chunk of spawned boids and the index of its first boid in the spawn transforms */
+	struct FBoidsSpawnChunk
+	{
+		FBoidsLocationFragment* Locations;
+		FMassVelocityFragment* Velocities;
+		FBoidsSpeedFragment* Speeds;
+		int32 NumEntities;
+		int32 Offset;
+	};
+}
 
 UBoidsSpawnProcessor::UBoidsSpawnProcessor(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
@@ -36,15 +49,15 @@ void UBoidsSpawnProcessor::ConfigureQueries()
 	Entities
 		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
 		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All)
-		.AddRequirement<FBoidsSpeedFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
-		.AddTagRequirement<FBoidsSpawnTag>(EMassFragmentPresence::All);
+		.AddRequirement<FBoidsSpeedFragment>(EMassFragmentAccess::ReadWrite, EMassFragmentPresence::All);
 }
 
 void UBoidsSpawnProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassExecutionContext& Context)
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsSpawnLocationProcessor);
 
-	if (!ensure(Context.ValidateAuxDataType<FMassTransformsSpawnData>()))
+	const bool bSnapshot = Context.ValidateAuxDataType<FBoidsSnapshotSpawnData>();
+	if (!ensure(bSnapshot || Context.ValidateAuxDataType<FMassTransformsSpawnData>()))
 	{
 		return;
 	}
@@ -54,63 +67,76 @@ void UBoidsSpawnProcessor::Execute(UMassEntitySubsystem& EntitySubsystem, FMassE
 	
 	if (World->GetNetMode() != NM_Client)
 	{
-		FMassTransformsSpawnData& AuxData = Context.GetMutableAuxData().GetMutable<FMassTransformsSpawnData>();
-		TArray<FTransform>& Transforms = AuxData.Transforms;
+		// Get the fragments of each chunk so that they can be set in parallel
+		TArray<FBoidsSpawnChunk> SpawnChunks;
+		int32 NumBoids = 0;
+		Entities.ForEachEntityChunk(EntitySubsystem, Context, [&SpawnChunks, &NumBoids](FMassExecutionContext& Context)
+		{
+			FBoidsSpawnChunk& SpawnChunk = SpawnChunks.AddDefaulted_GetRef();
+			SpawnChunk.Locations = Context.GetMutableFragmentView<FBoidsLocationFragment>().GetData();
+			SpawnChunk.Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>().GetData();
+			SpawnChunk.Speeds = Context.GetMutableFragmentView<FBoidsSpeedFragment>().GetData();
+			SpawnChunk.NumEntities = Context.GetNumEntities();
+			SpawnChunk.Offset = NumBoids;
+
+			NumBoids += SpawnChunk.NumEntities;
+		});
 
-		const int32 NumSpawnTransforms = Transforms.Num();
-		if (NumSpawnTransforms)
+		if (bSnapshot)
 		{
-			int32 NumRequiredSpawnTransforms = 0;
-			Entities.ForEachEntityChunk(EntitySubsystem, Context, [&NumRequiredSpawnTransforms](const FMassExecutionContext& Context)
+			const FBoidsSnapshotSpawnData& AuxData = Context.GetMutableAuxData().GetMutable<FBoidsSnapshotSpawnData>();
+			if (ensure(AuxData.Snapshot.IsValid() && AuxData.Boids.Num() == NumBoids))
 			{
-				NumRequiredSpawnTransforms += Context.GetNumEntities();
-			});
+				const FBoidsSnapshot& Snapshot = *AuxData.Snapshot;
+				const TArray<int32>& SnapshotBoids = AuxData.Boids;
 
-			const int32 NumToAdd = NumRequiredSpawnTransforms - NumSpawnTransforms;
-
-			// Make sure each entity has a location to spawn in
-			if (NumToAdd > 0)
-			{
-				Transforms.AddUninitialized(NumToAdd);
-				for (int32 Ndx = 0; Ndx < NumToAdd; Ndx++)
+				// Restore each boid as it was saved, its velocity is not derived from its max speed like spawned boids
+				ParallelFor(SpawnChunks.Num(), [&SpawnChunks, &Snapshot, &SnapshotBoids](int32 ChunkNdx)
 				{
-					Transforms[NumSpawnTransforms + Ndx] = Transforms[FMath::RandRange(0, NumSpawnTransforms - 1)];
-				}
+					const FBoidsSpawnChunk& SpawnChunk = SpawnChunks[ChunkNdx];
+
+					for (int32 Ndx = 0; Ndx < SpawnChunk.NumEntities; Ndx++)
+					{
+						const int32 SnapshotNdx = SnapshotBoids[SpawnChunk.Offset + Ndx];
+
+						SpawnChunk.Locations[Ndx].Location = Snapshot.GetLocation(SnapshotNdx);
+						SpawnChunk.Velocities[Ndx].Value = Snapshot.GetVelocity(SnapshotNdx);
+						SpawnChunk.Speeds[Ndx].MaxSpeed = Snapshot.GetSpeed(SnapshotNdx);
+					}
+				});
 			}
+		}
+		else
+		{
+			FMassTransformsSpawnData& AuxData = Context.GetMutableAuxData().GetMutable<FMassTransformsSpawnData>();
+			TArray<FTransform>& Transforms = AuxData.Transforms;
 
-			// Set the Location and Velocity of each boids
-			Entities.ForEachEntityChunk(EntitySubsystem, Context, [&Transforms, this](FMassExecutionContext& Context)
+			const int32 NumSpawnTransforms = Transforms.Num();
+			if (NumSpawnTransforms)
 			{
-				const TArrayView<FBoidsLocationFragment> Locations = Context.GetMutableFragmentView<FBoidsLocationFragment>();
-				const TArrayView<FMassVelocityFragment> Velocities = Context.GetMutableFragmentView<FMassVelocityFragment>();
-				const TConstArrayView<FBoidsSpeedFragment> Speeds = Context.GetFragmentView<FBoidsSpeedFragment>();
-
-				const int32 NumEntities = Context.GetNumEntities();
-				for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+				// Set the Location and Velocity of each boid from the transform of the same index, so the same spawn data always gives the same flock.
+				// Transforms are reused from the start when there are fewer than boids
+				ParallelFor(SpawnChunks.Num(), [&SpawnChunks, &Transforms, NumSpawnTransforms](int32 ChunkNdx)
 				{
-					const int32 AuxIndex = FMath::RandRange(0, Transforms.Num() - 1);
-					
-					Locations[Ndx].Location = Transforms[AuxIndex].GetLocation();
-					Velocities[Ndx].Value = Transforms[AuxIndex].GetRotation().Vector() * Speeds[Ndx].MaxSpeed;
-					
-					Transforms.RemoveAtSwap(AuxIndex, 1, false);
-				}
-			});
+					const FBoidsSpawnChunk& SpawnChunk = SpawnChunks[ChunkNdx];
+
+					for (int32 Ndx = 0; Ndx < SpawnChunk.NumEntities; Ndx++)
+					{
+						const FTransform& Transform = Transforms[(SpawnChunk.Offset + Ndx) % NumSpawnTransforms];
+
+						SpawnChunk.Locations[Ndx].Location = Transform.GetLocation();
+						SpawnChunk.Velocities[Ndx].Value = Transform.GetRotation().Vector() * SpawnChunk.Speeds[Ndx].MaxSpeed;
+					}
+				});
+			}
 		}
 
 		//
-		// Remove the SpawnedTag for all entities that have a spawn tag at the end of this processing phase
-		// This way all Processors will only process boids with the SpawnTag for a single frame
-		//
-		// All Boids are Created with a FBoidsSpawnTag to tell processors that this boids was created this frame so that
-		// they can do initial setup or whatever they need. Then this tag is removed for the next frame to signal that they no longer need this setup
-		FMassCommandBuffer& RemoveTagBuffer = BoidsSubsystem->GetEndCommandBuffer(EMassProcessingPhase::PrePhysics);
-		Entities.ForEachEntityChunk(EntitySubsystem, Context, [this, &RemoveTagBuffer] (FMassExecutionContext& Context)
+		// New boids are told apart by their fragments instead of a tag, so spawning never has to move them to another archetype.
+		// They have no render instance yet, and the render processor gives them one the next time it runs
+		if (ABoidsRenderActor* RenderActor = BoidsSubsystem->GetRenderActor())
 		{
-			for (const FMassEntityHandle& Entity : Context.GetEntities())
-			{
-				RemoveTagBuffer.RemoveTag<FBoidsSpawnTag>(Entity);
-			}
-		});
+			RenderActor->SetHasPendingInstances();
+		}
 	}
 }
@@ -6,10 +6,26 @@
 #include "MassProcessor.h"
 #include "BoidsSpawnProcessor.generated.h"
 
+class FBoidsSnapshot;
 class UBoidsSubsystem;
 
 /**
- * Processor that Updates the Location of Boids based on Velocity
+ * Spawn data restoring boids from a snapshot, the boids of a single entity type
+ */
+USTRUCT()
+struct MASSBOIDSGAME_API FBoidsSnapshotSpawnData
+{
+	GENERATED_BODY()
+
+	/** Snapshot the boids are read from, it stays mapped until the boids are spawned */
+	TSharedPtr<const FBoidsSnapshot> Snapshot;
+
+	/** Index in the snapshot of each boid to spawn */
+	TArray<int32> Boids;
+};
+
+/**
+ * Processor that sets the initial state of spawned boids, from spawn transforms or from a snapshot
  */
 UCLASS()
 class MASSBOIDSGAME_API UBoidsSpawnProcessor : public UMassProcessor
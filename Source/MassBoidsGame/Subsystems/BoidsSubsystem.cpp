@@ -2,13 +2,51 @@
 
 
 #include "BoidsSubsystem.h"
+#include "BoidsSnapshot.h"
+#include "Config/BoidsSettings.h"
+#include "Fragments/BoidsDormantTag.h"
+#include "Fragments/BoidsLocationFragment.h"
+#include "Fragments/BoidsMeshFragment.h"
+#include "Fragments/BoidsRenderInstanceFragment.h"
+#include "Fragments/BoidsRulesFragment.h"
+#include "Fragments/BoidsSpeedFragment.h"
+#include "Fragments/BoidsSteeringFragment.h"
+#include "Fragments/BoidsTurnBackFragment.h"
+#include "Processors/BoidsSpawnProcessor.h"
 
 #include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
 #include "Subsystems/SubsystemCollection.h"
 #include "MassActorSpawnerSubsystem.h"
 #include "MassCommandBuffer.h"
+#include "MassEntityQuery.h"
 #include "MassEntitySubsystem.h"
+#include "MassMovementFragments.h"
 #include "MassSimulationSubsystem.h"
+#include "MassSpawnerSubsystem.h"
+#include "MassSpawnerTypes.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoidsSubsystem, Log, All);
+
+namespace
+{
+	/** Get the const shared fragment of a type that the entities of a template are spawned with */
+	template<typename T>
+	const T* GetTemplateConstSharedFragment(const FMassEntityTemplate& Template)
+	{
+		for (const FConstSharedStruct& SharedFragment : Template.GetSharedFragmentValues().GetConstSharedFragments())
+		{
+			if (SharedFragment.GetScriptStruct() == T::StaticStruct())
+			{
+				return reinterpret_cast<const T*>(SharedFragment.GetMemory());
+			}
+		}
+
+		return nullptr;
+	}
+}
 
 void UBoidsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 {
@@ -16,6 +54,7 @@ void UBoidsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	
 	Collection.InitializeDependency<UMassSimulationSubsystem>();
 	Collection.InitializeDependency<UMassEntitySubsystem>();
+	Collection.InitializeDependency<UMassSpawnerSubsystem>();
 
 	UWorld* MyWorld = GetWorld();
 	check(MyWorld);
@@ -26,6 +65,13 @@ void UBoidsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	EntitySubsystem = UWorld::GetSubsystem<UMassEntitySubsystem>(MyWorld);
 	check(EntitySubsystem);
 
+	SpawnerSubsystem = UWorld::GetSubsystem<UMassSpawnerSubsystem>(MyWorld);
+	check(SpawnerSubsystem);
+
+	NumSpawns = 0;
+
+	LoadObstacleField();
+
 	// Create Command buffers for each processing phase and bind the flush command
 	for (int32 Ndx = 0; Ndx < static_cast<int32>(EMassProcessingPhase::MAX); Ndx++)
 	{
@@ -48,6 +94,9 @@ void UBoidsSubsystem::Deinitialize()
 		SimulationSubsystem->GetOnProcessingPhaseFinished(PairIt.Key).Remove(PairIt.Value);
 	}
 
+	DormantBoids.Reset();
+	ObstacleField.Reset();
+
 	// Reset the command buffer shared ptrs
 	for (auto&& PairIt : PhaseEndCommandBuffers)
 	{
@@ -80,7 +129,243 @@ void UBoidsSubsystem::OnWorldBeginPlay(UWorld& InWorld)
 	}
 }
 
+bool UBoidsSubsystem::LoadObstacleField()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsLoadObstacleField);
+
+	ObstacleField.Reset();
+
+	const UBoidsSettings* BoidsSettings = GetDefault<UBoidsSettings>();
+	if (!BoidsSettings->bObstacleAvoidance)
+	{
+		return false;
+	}
+
+	// Avoidance is enabled, so a missing field means boids fly through every obstacle
+	if (BoidsSettings->ObstacleFieldFile.IsEmpty())
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("Boids obstacle avoidance is enabled without an obstacle field file, boids will not avoid obstacles"));
+		return false;
+	}
+
+	const FString FilePath = FPaths::Combine(FPaths::ProjectContentDir(), BoidsSettings->ObstacleFieldFile);
+	if (!IFileManager::Get().FileExists(*FilePath))
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("Boids obstacle field %s does not exist, bake it with the BoidsBakeObstacles commandlet. Boids will not avoid obstacles"), *FilePath);
+		return false;
+	}
+
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *FilePath) || !ObstacleField.Load(Data))
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("Failed to load the boids obstacle field %s, it is not a valid field. Boids will not avoid obstacles"), *FilePath);
+		return false;
+	}
+
+	return true;
+}
+
+void UBoidsSubsystem::SetObstacleField(FBoidsDistanceField&& InObstacleField)
+{
+	ObstacleField = MoveTemp(InObstacleField);
+}
+
+bool UBoidsSubsystem::SaveSnapshot(const FString& FilePath, TConstArrayView<const FMassEntityTemplate*> EntityTypeTemplates)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsSaveSnapshot);
+
+	const int32 NumSpecies = FMath::Min(EntityTypeTemplates.Num(), MAX_uint8 + 1);
+	if (EntityTypeTemplates.Num() > NumSpecies)
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("Boids of the last %d entity types are not saved, a snapshot has at most %d species"), EntityTypeTemplates.Num() - NumSpecies, NumSpecies);
+	}
+
+	// The chunks of an entity type share the same mesh and rules fragments, which tells apart types with the same mesh and different rules
+	TArray<const FBoidsMeshFragment*> SpeciesMeshes;
+	TArray<const FBoidsRulesFragment*> SpeciesRules;
+	for (int32 TypeNdx = 0; TypeNdx < NumSpecies; TypeNdx++)
+	{
+		SpeciesMeshes.Add(EntityTypeTemplates[TypeNdx] ? GetTemplateConstSharedFragment<FBoidsMeshFragment>(*EntityTypeTemplates[TypeNdx]) : nullptr);
+		SpeciesRules.Add(EntityTypeTemplates[TypeNdx] ? GetTemplateConstSharedFragment<FBoidsRulesFragment>(*EntityTypeTemplates[TypeNdx]) : nullptr);
+	}
+
+	FBoidsVectorSoA Locations;
+	FBoidsVectorSoA Velocities;
+	TArray<float> Speeds;
+	TArray<uint8> Species;
+
+	// Retired boids are not part of the flock
+	FMassEntityQuery Query;
+	Query
+		.AddRequirement<FBoidsLocationFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FMassVelocityFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddRequirement<FBoidsSpeedFragment>(EMassFragmentAccess::ReadOnly, EMassFragmentPresence::All)
+		.AddConstSharedRequirement<FBoidsMeshFragment>(EMassFragmentPresence::All)
+		.AddConstSharedRequirement<FBoidsRulesFragment>(EMassFragmentPresence::All)
+		.AddTagRequirement<FBoidsDormantTag>(EMassFragmentPresence::None);
+
+	int32 NumUnsavedBoids = 0;
+
+	FMassExecutionContext Context(0.f);
+	Query.ForEachEntityChunk(*EntitySubsystem, Context, [&SpeciesMeshes, &SpeciesRules, &NumUnsavedBoids, &Locations, &Velocities, &Speeds, &Species](FMassExecutionContext& Context)
+	{
+		const FBoidsMeshFragment* Mesh = Context.GetConstSharedFragmentPtr<FBoidsMeshFragment>();
+		const FBoidsRulesFragment* Rules = Context.GetConstSharedFragmentPtr<FBoidsRulesFragment>();
+
+		int32 BoidSpecies = 0;
+		while (BoidSpecies < SpeciesMeshes.Num() && (SpeciesMeshes[BoidSpecies] != Mesh || SpeciesRules[BoidSpecies] != Rules))
+		{
+			BoidSpecies++;
+		}
+
+		if (BoidSpecies == SpeciesMeshes.Num())
+		{
+			NumUnsavedBoids += Context.GetNumEntities();
+			return;
+		}
+
+		const TConstArrayView<FBoidsLocationFragment> LocationList = Context.GetFragmentView<FBoidsLocationFragment>();
+		const TConstArrayView<FMassVelocityFragment> VelocityList = Context.GetFragmentView<FMassVelocityFragment>();
+		const TConstArrayView<FBoidsSpeedFragment> SpeedList = Context.GetFragmentView<FBoidsSpeedFragment>();
+
+		const int32 Offset = Locations.Num();
+		const int32 NumEntities = Context.GetNumEntities();
+
+		Locations.SetNumUninitialized(Offset + NumEntities);
+		Velocities.SetNumUninitialized(Offset + NumEntities);
+		Speeds.SetNumUninitialized(Offset + NumEntities, false);
+		Species.SetNumUninitialized(Offset + NumEntities, false);
+
+		for (int32 Ndx = 0; Ndx < NumEntities; Ndx++)
+		{
+			Locations.Set(Offset + Ndx, LocationList[Ndx].Location);
+			Velocities.Set(Offset + Ndx, VelocityList[Ndx].Value);
+			Speeds[Offset + Ndx] = SpeedList[Ndx].MaxSpeed;
+			Species[Offset + Ndx] = (uint8)BoidSpecies;
+		}
+	});
+
+	if (!FBoidsSnapshot::Save(*FilePath, Locations, Velocities, Speeds, Species))
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("Failed to save the boids snapshot %s"), *FilePath);
+		return false;
+	}
+
+	if (NumUnsavedBoids > 0)
+	{
+		UE_LOG(LogBoidsSubsystem, Warning, TEXT("%d boids are not saved to %s, they are not of any of the %d entity types"), NumUnsavedBoids, *FilePath, NumSpecies);
+	}
+
+	UE_LOG(LogBoidsSubsystem, Log, TEXT("Saved %d boids of %d species to %s"), Locations.Num(), NumSpecies, *FilePath);
+	return true;
+}
+
+int32 UBoidsSubsystem::GetNextSpawnSeed()
+{
+	return (int32)HashCombine(GetTypeHash(GetDefault<UBoidsSettings>()->SpawnSeed), GetTypeHash(NumSpawns++));
+}
+
+void UBoidsSubsystem::SpawnBoids(const FMassEntityTemplateID TemplateID, TConstArrayView<FTransform> Transforms, TArray<FMassEntityHandle>& OutEntities)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsSpawnBoids);
+
+	int32 NumReactivated = 0;
+
+	// Reuse the most recently retired boids first
+	if (TArray<FMassEntityHandle>* Dormant = DormantBoids.Find(TemplateID))
+	{
+		NumReactivated = FMath::Min(Dormant->Num(), Transforms.Num());
+
+		const TConstArrayView<FMassEntityHandle> Reactivated = MakeArrayView(Dormant->GetData() + Dormant->Num() - NumReactivated, NumReactivated);
+		ReactivateBoids(Reactivated, Transforms.Left(NumReactivated));
+
+		OutEntities.Append(Reactivated.GetData(), Reactivated.Num());
+		Dormant->SetNum(Dormant->Num() - NumReactivated, false);
+	}
+
+	const int32 NumToSpawn = Transforms.Num() - NumReactivated;
+	if (NumToSpawn > 0)
+	{
+		FMassTransformsSpawnData SpawnData;
+		SpawnData.Transforms.Append(Transforms.GetData() + NumReactivated, NumToSpawn);
+
+		TArray<FMassEntityHandle> SpawnedEntities;
+		SpawnerSubsystem->SpawnEntities(TemplateID, NumToSpawn, FConstStructView::Make(SpawnData), UBoidsSpawnProcessor::StaticClass(), SpawnedEntities);
+
+		OutEntities.Append(SpawnedEntities);
+	}
+}
+
+void UBoidsSubsystem::RetireBoids(const FMassEntityTemplateID TemplateID, TConstArrayView<FMassEntityHandle> Entities)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_BoidsRetireBoids);
+
+	TArray<FMassEntityHandle>& Dormant = DormantBoids.FindOrAdd(TemplateID);
+	Dormant.Reserve(Dormant.Num() + Entities.Num());
+
+	for (const FMassEntityHandle Entity : Entities)
+	{
+		if (!EntitySubsystem->IsEntityValid(Entity))
+		{
+			continue;
+		}
+
+		// Hide the boid by giving its instance back, the last instance of the mesh takes its place
+		FBoidsRenderInstanceFragment& Instance = EntitySubsystem->GetFragmentDataChecked<FBoidsRenderInstanceFragment>(Entity);
+		if (RenderActor && Instance.InstanceIndex != INDEX_NONE)
+		{
+			const FMassEntityHandle MovedEntity = RenderActor->RemoveInstance(Instance.MeshIndex, Instance.InstanceIndex);
+			if (MovedEntity.IsSet())
+			{
+				EntitySubsystem->GetFragmentDataChecked<FBoidsRenderInstanceFragment>(MovedEntity).InstanceIndex = Instance.InstanceIndex;
+			}
+		}
+
+		Instance.InstanceIndex = INDEX_NONE;
+		Instance.NewTileIndex = INDEX_NONE;
+
+		// Still one archetype move per boid, there is no batched tag change in this engine version, but the entity is neither destroyed nor created again
+		EntitySubsystem->AddTagToEntity(Entity, FBoidsDormantTag::StaticStruct());
+		Dormant.Add(Entity);
+	}
+}
+
+int32 UBoidsSubsystem::GetNumDormantBoids(const FMassEntityTemplateID TemplateID) const
+{
+	const TArray<FMassEntityHandle>* Dormant = DormantBoids.Find(TemplateID);
+	return Dormant ? Dormant->Num() : 0;
+}
+
+void UBoidsSubsystem::ReactivateBoids(TConstArrayView<FMassEntityHandle> Entities, TConstArrayView<FTransform> Transforms)
+{
+	check(Entities.Num() == Transforms.Num());
+
+	for (int32 Ndx = 0; Ndx < Entities.Num(); Ndx++)
+	{
+		const FMassEntityHandle Entity = Entities[Ndx];
+
+		// Same initial state as the spawn processor gives new boids
+		const float MaxSpeed = EntitySubsystem->GetFragmentDataChecked<FBoidsSpeedFragment>(Entity).MaxSpeed;
+		EntitySubsystem->GetFragmentDataChecked<FBoidsLocationFragment>(Entity).Location = Transforms[Ndx].GetLocation();
+		EntitySubsystem->GetFragmentDataChecked<FMassVelocityFragment>(Entity).Value = Transforms[Ndx].GetRotation().Vector() * MaxSpeed;
+		EntitySubsystem->GetFragmentDataChecked<FBoidsSteeringFragment>(Entity).Value = FVector::ZeroVector;
+		EntitySubsystem->GetFragmentDataChecked<FBoidsTurnBackFragment>(Entity).Value = FVector::ZeroVector;
+
+		EntitySubsystem->RemoveTagFromEntity(Entity, FBoidsDormantTag::StaticStruct());
+	}
+
+	if (RenderActor && Entities.Num() > 0)
+	{
+		RenderActor->SetHasPendingInstances();
+	}
+}
+
 void UBoidsSubsystem::OnProcessingPhaseFinished(const float DeltaSeconds, const EMassProcessingPhase Phase)
+{
+	FlushEndCommandBuffer(Phase);
+}
+
+void UBoidsSubsystem::FlushEndCommandBuffer(const EMassProcessingPhase Phase)
 {
 	// Execute command buffer for the phase
 	if (PhaseEndCommandBuffers.Contains(Phase))
@@ -5,12 +5,15 @@
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
 #include "MassProcessingTypes.h"
+#include "MassEntityTemplate.h"
 #include "Actors/BoidsRenderActor.h"
+#include "BoidsDistanceField.h"
 #include "BoidsSubsystem.generated.h"
 
 class UMassActorSpawnerSubsystem;
 class UMassSimulationSubsystem;
 class UMassEntitySubsystem;
+class UMassSpawnerSubsystem;
 
 /**
  * Subsystem for Boids world
@@ -35,6 +38,18 @@ class MASSBOIDSGAME_API UBoidsSubsystem : public UWorldSubsystem
 	UPROPERTY(Transient)
 	ABoidsRenderActor* RenderActor;
 
+	UPROPERTY(Transient)
+	UMassSpawnerSubsystem* SpawnerSubsystem;
+
+	/** Number of spawns in this world, each spawn is seeded with it */
+	int32 NumSpawns;
+
+	/** Retired boids of each entity template, waiting to be reactivated by SpawnBoids */
+	TMap<FMassEntityTemplateID, TArray<FMassEntityHandle>> DormantBoids;
+
+	/** Distance to the obstacles of the world, boids steer away from them */
+	FBoidsDistanceField ObstacleField;
+
 public:
 	
 	// ~ begin USubsystem interface
@@ -52,6 +67,50 @@ public:
 		return *PhaseEndCommandBuffers[InPhase].Get();
 	}
 
+	/** Execute the commands queued for the end of a processing phase */
+	void FlushEndCommandBuffer(const EMassProcessingPhase InPhase);
+
+	/** Get the seed of the next spawn, from the spawn seed of the settings and the spawns so far */
+	int32 GetNextSpawnSeed();
+
+	/**
+	 * Spawn boids of an entity template at the given transforms, reactivating boids retired from the same template first and only creating
+	 * entities for the rest. Must be called outside of Mass processing.
+	 * Only boids spawned and retired through the subsystem are pooled, Mass spawner actors still create and destroy their entities
+	 */
+	void SpawnBoids(const FMassEntityTemplateID TemplateID, TConstArrayView<FTransform> Transforms, TArray<FMassEntityHandle>& OutEntities);
+
+	/**
+	 * Retire boids of an entity template instead of destroying them. They keep their entity, are skipped by every processor and lose their
+	 * render instance until SpawnBoids reactivates them. Must be called outside of Mass processing
+	 */
+	void RetireBoids(const FMassEntityTemplateID TemplateID, TConstArrayView<FMassEntityHandle> Entities);
+
+	/** Get the number of retired boids of an entity template */
+	int32 GetNumDormantBoids(const FMassEntityTemplateID TemplateID) const;
+
+	/**
+	 * Load the obstacle distance field from the file in the settings, when obstacle avoidance is enabled. Returns false when there is no
+	 * valid field to load, and warns if avoidance is enabled but the file is missing or invalid
+	 */
+	bool LoadObstacleField();
+
+	/** Replace the obstacle distance field, such as with one built at runtime */
+	void SetObstacleField(FBoidsDistanceField&& InObstacleField);
+
+	/**
+	 * Save every active boid to a snapshot file, to spawn them again with UBoidsSnapshotSpawnDataGenerator. EntityTypeTemplates are the
+	 * templates of the entity types of the spawner that spawns the snapshot, in its order. The species of a boid is the index of the entity
+	 * type with its mesh and rules, boids of no entity type are not saved. Must be called outside of Mass processing
+	 */
+	bool SaveSnapshot(const FString& FilePath, TConstArrayView<const FMassEntityTemplate*> EntityTypeTemplates);
+
+	/** Gets the distance field of the obstacles boids avoid, which is empty when the world has none */
+	FORCEINLINE const FBoidsDistanceField& GetObstacleField() const
+	{
+		return ObstacleField;
+	}
+
 	/** Gets the actor responsible for rendering boids */
 	FORCEINLINE ABoidsRenderActor* GetRenderActor() const
 	{
@@ -59,6 +118,9 @@ public:
 	}
 
 private:
+
+	/** Move retired boids to new transforms and make them active again, they get a render instance the next time boids are rendered */
+	void ReactivateBoids(TConstArrayView<FMassEntityHandle> Entities, TConstArrayView<FTransform> Transforms);
 	
 	void OnProcessingPhaseFinished(const float DeltaSeconds, const EMassProcessingPhase Phase);
 };